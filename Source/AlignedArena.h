@@ -0,0 +1,93 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Cache line size; every piece of the arena starts on one.
+#define ARENA_ALIGNMENT 64
+
+// A run of count Ts inside an AlignedArena. It owns nothing: the memory
+// lives as long as the arena's current layout.
+template <typename T>
+struct ArenaArray
+{
+    T* pointer{ nullptr };
+    size_t count{ 0 };
+
+    T* data() const { return pointer; }
+    T* begin() const { return pointer; }
+    T* end() const { return pointer + count; }
+    size_t size() const { return count; }
+    T& operator[](size_t i) const { return pointer[i]; }
+};
+
+// One cache-line-aligned block of working memory for a whole engine,
+// allocated once while preparing. prepare() runs the owner's layout
+// function twice: the first pass only adds up what take() is asked for,
+// then the block is allocated at exactly that size and the second pass
+// hands out the pieces, value-initialised. Layout functions must ask for
+// the same pieces both times and must not touch their memory until the
+// second pass, see isMeasuring().
+// The arena never runs destructors, so it only holds trivially
+// destructible types, and everything taken from it is invalidated by the
+// next prepare().
+class AlignedArena
+{
+    struct Deleter
+    {
+        void operator()(std::byte* memory) const {
+            ::operator delete[](memory, std::align_val_t(ARENA_ALIGNMENT));
+        }
+    };
+
+    std::unique_ptr<std::byte[], Deleter> memory;
+    size_t capacity{ 0 };
+    size_t used{ 0 };
+    bool measuring{ false };
+
+public:
+
+    template <typename Layout>
+    void prepare(Layout&& layout) {
+        used = 0;
+        measuring = true;
+        layout(*this);
+
+        // Reallocate on any change, so an instance holds exactly what its
+        // current layout needs.
+        if (used != capacity) {
+            memory.reset(used > 0 ? static_cast<std::byte*>(::operator new[](used, std::align_val_t(ARENA_ALIGNMENT))) : nullptr);
+            capacity = used;
+        }
+
+        used = 0;
+        measuring = false;
+        layout(*this);
+        jassert(used == capacity);
+    }
+
+    template <typename T>
+    ArenaArray<T> take(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+        static_assert(alignof(T) <= ARENA_ALIGNMENT, "the arena only aligns to cache lines");
+
+        auto offset = (used + ARENA_ALIGNMENT - 1) & ~static_cast<size_t>(ARENA_ALIGNMENT - 1);
+        used = offset + count * sizeof(T);
+        if (measuring) return { nullptr, count };
+
+        jassert(used <= capacity);
+        auto* pointer = reinterpret_cast<T*>(memory.get() + offset);
+        std::uninitialized_value_construct_n(pointer, count);
+        return { pointer, count };
+    }
+
+    // True during the first pass of prepare(), when take() hands out no
+    // memory yet.
+    bool isMeasuring() const { return measuring; }
+
+    // Bytes held, padding included.
+    size_t getSize() const { return capacity; }
+};
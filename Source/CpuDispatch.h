@@ -0,0 +1,135 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// The build targets the oldest CPUs we ship for. Hot kernels are compiled
+// once more for each wider instruction set below, and the engine picks the
+// best variant the CPU supports when it is prepared.
+enum class InstructionSet { sse2, avx2, avx512 };
+enum { INSTRUCTION_SET_COUNT = 3 };
+
+// Per-function target attributes are a GCC and Clang extension. Elsewhere,
+// MSVC included, and on non-Intel targets, every variant is the baseline
+// build (sse2 then stands for whatever that is).
+#if (JUCE_GCC || JUCE_CLANG) && JUCE_INTEL
+ #define CPU_DISPATCH 1
+#else
+ #define CPU_DISPATCH 0
+#endif
+
+namespace CpuDispatch
+{
+    // Target<set>::run(fn) calls fn compiled for set: the wrapper carries
+    // the target attribute and flatten inlines the whole call tree of fn
+    // into it. Calls the inliner cannot follow (function pointers, other
+    // translation units) run their baseline versions, so nothing built
+    // for a wider set escapes the wrapper.
+    // Every variant gives bit-identical output as long as no multiply-adds
+    // are fused. The avx2 variant leaves FMA off; AVX-512 brings its own,
+    // which is why the GCC and Clang exporters build the file with the
+    // variants, MultibandDistortion.cpp, with -ffp-contract=off (the
+    // fpContractOff compiler flag scheme). MSVC does not contract at its
+    // default /fp:precise.
+    template <InstructionSet>
+    struct Target
+    {
+        template <typename Fn>
+        static void run(Fn&& fn) { fn(); }
+    };
+
+   #if CPU_DISPATCH
+    template <>
+    struct Target<InstructionSet::avx2>
+    {
+        template <typename Fn>
+        __attribute__((target("avx2"), flatten)) static void run(Fn&& fn) { fn(); }
+    };
+
+    template <>
+    struct Target<InstructionSet::avx512>
+    {
+        template <typename Fn>
+        __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq"), flatten)) static void run(Fn&& fn) { fn(); }
+    };
+   #endif
+
+    template <InstructionSet Set, typename Fn>
+    inline void run(Fn&& fn) {
+        Target<Set>::run(std::forward<Fn>(fn));
+    }
+
+    // Calls fn with set as a std::integral_constant, so a variant can be
+    // picked as a template argument: decltype(set)::value.
+    template <typename Fn>
+    inline void select(InstructionSet set, Fn&& fn) {
+        switch (set) {
+            case InstructionSet::avx512: fn(std::integral_constant<InstructionSet, InstructionSet::avx512>{}); break;
+            case InstructionSet::avx2: fn(std::integral_constant<InstructionSet, InstructionSet::avx2>{}); break;
+            default: fn(std::integral_constant<InstructionSet, InstructionSet::sse2>{}); break;
+        }
+    }
+
+    inline const char* getName(InstructionSet set) {
+        switch (set) {
+            case InstructionSet::avx512: return "avx512";
+            case InstructionSet::avx2: return "avx2";
+            default: return "sse2";
+        }
+    }
+
+    // The widest set the CPU and the OS support, from CPUID. Run once and
+    // cached.
+    inline InstructionSet detect() {
+        static const auto detected = [] {
+           #if CPU_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl")
+             && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) return InstructionSet::avx512;
+            if (__builtin_cpu_supports("avx2")) return InstructionSet::avx2;
+           #endif
+            return InstructionSet::sse2;
+        }();
+        return detected;
+    }
+
+    namespace detail
+    {
+        // -1 while nothing is forced. Starts from the environment variable
+        // ATTILA_INSTRUCTION_SET (sse2, avx2 or avx512), if set.
+        inline std::atomic<int>& forced() {
+            static std::atomic<int> set{ [] {
+                auto* name = std::getenv("ATTILA_INSTRUCTION_SET");
+                for (int i = 0; name != nullptr && i < INSTRUCTION_SET_COUNT; ++i) {
+                    if (std::strcmp(name, getName(static_cast<InstructionSet>(i))) == 0) return i;
+                }
+                return -1;
+            }() };
+            return set;
+        }
+    }
+
+    // Pins every engine prepared from now on to one variant, for testing.
+    // Sets the CPU lacks fall back to the widest it has.
+    inline void force(InstructionSet set) {
+        jassert(static_cast<int>(set) <= static_cast<int>(detect()));
+        detail::forced().store(static_cast<int>(set));
+    }
+
+    // Back to the detected set.
+    inline void unforce() {
+        detail::forced().store(-1);
+    }
+
+    // The set engines are prepared for: the forced one or the detected one.
+    inline InstructionSet getInstructionSet() {
+        auto forced = detail::forced().load();
+        auto detected = static_cast<int>(detect());
+        return static_cast<InstructionSet>(forced < 0 ? detected : std::min(forced, detected));
+    }
+}
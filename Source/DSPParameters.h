@@ -11,16 +11,19 @@ class DSPParameters
 public:
     unordered_map<string, T> parameters;
 
-    T operator[] (string key) {
-        if (parameters.find(key) != parameters.end()) {
-            return parameters[key];
+    // Keys are taken by reference: neither a lookup nor overwriting a key
+    // that is already there allocates.
+    T operator[] (const string& key) const {
+        auto found = parameters.find(key);
+        if (found != parameters.end()) {
+            return found->second;
         }
         else {
             return 1.0f;
         }
     }
 
-    void set(string key, T value) {
+    void set(const string& key, T value) {
         parameters[key] = value;
     }
 
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <JuceHeader.h>
+
+// Polynomial approximations of exp2, log2, pow, atan and tan for the per-sample
+// path, so the shaper does not have to call libm. Every function takes an
+// accuracy tier. Maximum errors, measured in float against libm:
+//
+//   tier       exp2 (relative)   log2 (absolute)   atan (absolute)   tan (relative)
+//   fast       8.6e-5            1.1e-4            8.2e-5            4.5e-5
+//   balanced   3.0e-6            2.3e-6            1.9e-6            3.5e-6
+//   precise    1.8e-7            1.6e-7            3.8e-7            6.5e-7
+//
+// The log2 figures are for the mantissa polynomial; far from 1 the float
+// rounding of the result (half an ulp of the exponent part) comes on top.
+// pow(x, y) is exp2(y * log2(x)), so its relative error is about
+// exp2 error + ln(2) * |y| * log2 error. exp2 of an integer and log2 of a
+// power of two are exact, so e.g. unity gains stay exactly 1. The tan
+// figures hold for |x| < 1.5, which covers cutoffs up to 0.47 fs.
+//
+// Lane versions live in LaneUtils.h. Tests/FastMathTests.cpp holds every
+// tier to the bounds above.
+namespace FastMath
+{
+    enum class Accuracy { fast, balanced, precise };
+
+    namespace detail
+    {
+        // 2^f = 1 + f * p(f) on [0, 1), fitted for minimax relative error.
+        template <Accuracy> struct Exp2;
+        template <> struct Exp2<Accuracy::fast> {
+            static constexpr float c[] = { 0.69511654f, 0.22764611f, 0.07706602f };
+        };
+        template <> struct Exp2<Accuracy::balanced> {
+            static constexpr float c[] = { 0.69304485f, 0.24128015f, 0.05224260f, 0.01342661f };
+        };
+        template <> struct Exp2<Accuracy::precise> {
+            static constexpr float c[] = { 0.69315131f, 0.24016445f, 0.05579991f, 0.00901704f, 0.00186713f };
+        };
+
+        // log2(1 + t) = t * p(t) on [sqrt(1/2) - 1, sqrt(2) - 1].
+        template <Accuracy> struct Log2;
+        template <> struct Log2<Accuracy::fast> {
+            static constexpr float c[] = { 1.44176076f, -0.72490388f, 0.51750729f, -0.32962995f };
+        };
+        template <> struct Log2<Accuracy::balanced> {
+            static constexpr float c[] = { 1.44271348f, -0.72113186f, 0.47934798f, -0.36748993f, 0.32215529f, -0.20659269f };
+        };
+        template <> struct Log2<Accuracy::precise> {
+            static constexpr float c[] = { 1.44269477f, -0.72135715f, 0.48093945f, -0.36008719f, 0.28670733f, -0.25006921f, 0.23689145f, -0.14574532f };
+        };
+
+        // atan(z) = z * p(z^2) on [0, 1].
+        template <Accuracy> struct Atan;
+        template <> struct Atan<Accuracy::fast> {
+            static constexpr float c[] = { 0.99921383f, -0.32117515f, 0.14626489f, -0.03898680f };
+        };
+        template <> struct Atan<Accuracy::balanced> {
+            static constexpr float c[] = { 0.99997722f, -0.33262281f, 0.19354024f, -0.11642612f, 0.05264693f, -0.01171896f };
+        };
+        template <> struct Atan<Accuracy::precise> {
+            static constexpr float c[] = { 0.99999611f, -0.33317367f, 0.19807810f, -0.13233319f, 0.07962324f, -0.03360384f, 0.00681166f };
+        };
+
+        // tan(z) = z * p(z^2) on [0, pi/4].
+        template <Accuracy> struct Tan;
+        template <> struct Tan<Accuracy::fast> {
+            static constexpr float c[] = { 0.99995577f, 0.33558339f, 0.11597522f, 0.09413023f };
+        };
+        template <> struct Tan<Accuracy::balanced> {
+            static constexpr float c[] = { 1.00000322f, 0.33307976f, 0.13651747f, 0.04039819f, 0.04382059f };
+        };
+        template <> struct Tan<Accuracy::precise> {
+            static constexpr float c[] = { 0.99999976f, 0.33335963f, 0.13284755f, 0.05719220f, 0.01251239f, 0.02040142f };
+        };
+
+        template <size_t I = 0, size_t N>
+        inline float horner(const float (&c)[N], float x) {
+            if constexpr (I + 1 == N) return c[I];
+            else return horner<I + 1>(c, x) * x + c[I];
+        }
+
+        inline uint32_t toBits(float x) {
+            uint32_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));
+            return bits;
+        }
+
+        inline float fromBits(uint32_t bits) {
+            float x;
+            std::memcpy(&x, &bits, sizeof(x));
+            return x;
+        }
+
+        // condition ? a : b as a bit blend. Compilers keep float ternaries
+        // as branches unless FP traps are disabled, which stops the lane
+        // loops from vectorizing; this form has no control flow.
+        inline float select(bool condition, float a, float b) {
+            auto mask = 0u - static_cast<uint32_t>(condition);
+            return fromBits((toBits(a) & mask) | (toBits(b) & ~mask));
+        }
+    }
+
+    template <Accuracy A = Accuracy::balanced>
+    inline float exp2(float x) {
+        // NaN fails both comparisons, lands on the upper clamp and is then
+        // flushed to 0 with the underflow below.
+        auto clamped = detail::select(x < 126.0f, x, 126.0f);
+        clamped = detail::select(clamped > -126.0f, clamped, -126.0f);
+        auto whole = static_cast<int>(clamped);
+        whole -= static_cast<int>(clamped < static_cast<float>(whole));
+        auto fraction = clamped - static_cast<float>(whole);
+
+        auto mantissa = 1.0f + fraction * detail::horner(detail::Exp2<A>::c, fraction);
+        auto result = detail::fromBits(detail::toBits(mantissa) + (static_cast<uint32_t>(whole) << 23));
+        return detail::select(x > -126.0f, result, 0.0f);
+    }
+
+    template <Accuracy A = Accuracy::balanced>
+    inline float log2(float x) {
+        auto bits = detail::toBits(x);
+        auto exponent = static_cast<int>((bits >> 23) & 0xFF) - 127;
+        auto mantissa = detail::fromBits((bits & 0x007FFFFF) | 0x3F800000);
+
+        // Centre the mantissa on 1 so the polynomial only spans [-0.29, 0.41].
+        auto high = mantissa > 1.41421356f;
+        mantissa *= detail::select(high, 0.5f, 1.0f);
+        exponent += static_cast<int>(high);
+
+        auto t = mantissa - 1.0f;
+        auto result = static_cast<float>(exponent) + t * detail::horner(detail::Log2<A>::c, t);
+        return detail::select(x >= std::numeric_limits<float>::min(), result, -std::numeric_limits<float>::infinity());
+    }
+
+    // x^y for x >= 0. Zero and denormal bases give 0 for positive y.
+    template <Accuracy A = Accuracy::balanced>
+    inline float pow(float x, float y) {
+        return exp2<A>(y * log2<A>(x));
+    }
+
+    // Same as std::trunc, except that -0.5 gives +0. Past 2^23 every float is
+    // already whole; below that the int round trip drops the fraction.
+    inline float trunc(float x) {
+        auto inRange = std::abs(x) < 8388608.0f;
+        auto truncated = static_cast<float>(static_cast<int32_t>(detail::select(inRange, x, 0.0f)));
+        return detail::select(inRange, truncated, x);
+    }
+
+    template <Accuracy A = Accuracy::balanced>
+    inline float atan(float x) {
+        auto a = std::abs(x);
+        auto inverted = a > 1.0f;
+        auto z = detail::select(inverted, 1.0f / detail::select(inverted, a, 1.0f), a);
+        auto result = z * detail::horner(detail::Atan<A>::c, z * z);
+        result = detail::select(inverted, 1.57079633f - result, result);
+        return detail::fromBits(detail::toBits(result) | (detail::toBits(x) & 0x80000000));
+    }
+
+    // tan(x) for |x| < pi/2. Past pi/4 it is 1 / tan(pi/2 - |x|), so the
+    // polynomial only spans [0, pi/4].
+    template <Accuracy A = Accuracy::balanced>
+    inline float tan(float x) {
+        auto a = std::abs(x);
+        auto inverted = a > 0.78539816f;
+        auto z = detail::select(inverted, 1.57079633f - a, a);
+        auto result = z * detail::horner(detail::Tan<A>::c, z * z);
+        result = detail::select(inverted, 1.0f / detail::select(inverted, result, 1.0f), result);
+        return detail::fromBits(detail::toBits(result) | (detail::toBits(x) & 0x80000000));
+    }
+}
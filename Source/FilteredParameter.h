@@ -3,8 +3,12 @@
 
 #define DEFAULT_FILTER_FREQ 3.5f
 #define DEFAULT_SR          44100.0f
+#define CONTROL_BLOCK_SIZE  32
+#define SETTLED_THRESHOLD   0.00001f
 #define M_PI 3.14159265358979323846
 #include <cmath>
+#include <algorithm>
+#include "FastMath.h"
 
 // Utility functions
 template<typename T>
@@ -12,6 +16,23 @@ T lengthToSamples(T sr, T n) noexcept {
     return sr * n * static_cast<T>(0.001);
 }
 
+// A parameter trajectory over one control block: sample i of the block
+// reads start + increment * i. Smoothers hand these out once per block
+// instead of being stepped for every sample.
+struct ParameterRamp
+{
+    float start{ 0.0f };
+    float increment{ 0.0f };
+
+    bool isConstant() const {
+        return increment == 0.0f;
+    }
+
+    float operator[](int i) const {
+        return start + increment * static_cast<float>(i);
+    }
+};
+
 class OnePoleFilter
 {
 public:
@@ -24,7 +45,8 @@ public:
 	}
 
 	void setFrequency(float freq) {
-		b1 = exp(-2.0f * M_PI * (freq));
+		// e^(-2 pi f) written as a power of two.
+		b1 = FastMath::exp2<FastMath::Accuracy::precise>(static_cast<float>(-2.0 * M_PI * 1.4426950408889634) * freq);
 		a0 = 1.0f - b1;
 	}
 
@@ -44,8 +66,30 @@ public:
 		return process(in);
 	}
 
+	// Run the filter over numSamples of a constant input in one step:
+	// after n samples the state has covered 1 - b1^n of the distance.
+	float processConstant(float in, int numSamples) {
+		if (numSamples != decayLength || b1 != decayCoefficient) {
+			decayLength = numSamples;
+			decayCoefficient = b1;
+			decay = FastMath::pow<FastMath::Accuracy::precise>(b1, static_cast<float>(numSamples));
+		}
+		z1 = in + (z1 - in) * decay;
+		return z1;
+	}
+
+	float getState() const {
+		return z1;
+	}
+
+	void reset(float v) {
+		z1 = v;
+	}
+
 protected:
 	float a0{ 1.0 }, b1{ 0.0 }, z1{ 0.0 };
+	float decay{ 0.0f }, decayCoefficient{ 0.0f };
+	int decayLength{ 0 };
 	float sampleRate{ DEFAULT_SR };
 };
 
@@ -75,6 +119,36 @@ public:
         return filter.process(value);
     }
 
+    // Advance a whole control block at once. The ramp runs from the last
+    // output to where the one-pole filter would be after numSamples, so the
+    // DEFAULT_FILTER_FREQ response is kept at the block boundaries. Once the
+    // value has settled the ramp is constant and kernels can hoist it.
+    ParameterRamp ramp(int numSamples) {
+        auto previous = filter.getState();
+        if (isSettled()) {
+            filter.reset(value);
+            return { value, 0.0f };
+        }
+        auto target = filter.processConstant(value, numSamples);
+        // Close to the value a block's worth of decay can round to nothing
+        // and the filter would stall a few ulps short; snap instead.
+        if (target == previous) {
+            filter.reset(value);
+            return { value, 0.0f };
+        }
+        auto increment = (target - previous) / static_cast<float>(numSamples);
+        return { previous + increment, increment };
+    }
+
+    bool isSettled() const {
+        return std::abs(filter.getState() - value) <= SETTLED_THRESHOLD * std::max(1.0f, std::abs(value));
+    }
+
+    // Jump straight to the current value, e.g. right after preparing.
+    void reset() {
+        filter.reset(value);
+    }
+
     // Just return current value
     float read() {
         return value;
@@ -90,13 +164,17 @@ class SmoothLogParameter
     float currentGain, targetGain, multiplier;
     float attackTime, releaseTime, fadeSize{ 1.0f };
     float sampleRate{ DEFAULT_SR };
+    float blockMultiplier{ 1.0f };
+    int blockLength{ 0 };
 
 public:
     SmoothLogParameter(float atk = 150.0f, float rls = 150.0f) : attackTime(atk), releaseTime(rls), currentGain(SILENCE), targetGain(SILENCE), multiplier(1.0) {}
 
+    // Starts settled at v. The gain never quite reaches zero, or a fade
+    // up from there could not get going.
     void prepare(float sr, float v) {
         sampleRate = sr;
-        currentGain = v;
+        currentGain = std::max(v, SILENCE);
         setValue(v);
     }
 
@@ -104,11 +182,12 @@ public:
         targetGain = v + SILENCE;
         if (targetGain < currentGain) fadeSize = lengthToSamples(releaseTime, sampleRate);
         else if (targetGain > currentGain) fadeSize = lengthToSamples(attackTime, sampleRate);
-        multiplier = std::pow(targetGain / currentGain, 1.0f / fadeSize);
+        multiplier = FastMath::pow<FastMath::Accuracy::precise>(targetGain / currentGain, 1.0f / fadeSize);
+        blockLength = 0;
     }
 
     float next() {
-        if (std::abs(currentGain - targetGain) > 0.0001f) {
+        if (!isSettled()) {
             currentGain *= multiplier;
             if ((multiplier > 1.0f && currentGain >= targetGain) || (multiplier < 1.0f && currentGain <= targetGain)) {
                 currentGain = targetGain;
@@ -117,6 +196,40 @@ public:
         return currentGain;
     }
 
+    // Exponential fade over a whole control block: the end point follows
+    // the same multiplier^n curve as next(), the samples in between are
+    // interpolated linearly.
+    ParameterRamp ramp(int numSamples) {
+        if (isSettled()) return { currentGain, 0.0f };
+
+        if (numSamples != blockLength) {
+            blockLength = numSamples;
+            blockMultiplier = FastMath::pow<FastMath::Accuracy::precise>(multiplier, static_cast<float>(numSamples));
+        }
+
+        auto previous = currentGain;
+        currentGain *= blockMultiplier;
+        if ((multiplier > 1.0f && currentGain >= targetGain) || (multiplier < 1.0f && currentGain <= targetGain)) {
+            currentGain = targetGain;
+        }
+        auto increment = (currentGain - previous) / static_cast<float>(numSamples);
+        return { previous + increment, increment };
+    }
+
+    bool isSettled() const {
+        return std::abs(currentGain - targetGain) <= 0.0001f;
+    }
+
+    // Faded out completely: whatever the gain scales can be skipped.
+    bool isSilent() const {
+        return isSettled() && targetGain <= SILENCE;
+    }
+
+    // Jump straight to the target, ending any fade.
+    void reset() {
+        currentGain = targetGain;
+    }
+
     float read() {
         return currentGain;
     }
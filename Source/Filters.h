@@ -1,46 +1,96 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "FastMath.h"
 
 #define M_PI 3.14159265358979323846
 #define DEFAULT_SR 44100.0f
 
+// Linkwitz-Riley crossover built from two cascaded TPT state-variable
+// sections, the same structure juce::dsp::LinkwitzRileyFilter uses.
+// T is the sample type: with a juce::dsp::SIMDRegister every lane is an
+// independent channel, so the whole per-channel state fits in s1..s4 and
+// all channels are filtered by one pass.
 template <typename T>
 struct LRFilter
 {
-	juce::dsp::LinkwitzRileyFilter<float> filter;
-	int type{ 0 };
-	T frequency{ 0.0f };
+	T s1{}, s2{}, s3{}, s4{};
 
-	float sampleRate{ DEFAULT_SR };
-	float blockSize{ 0.0f };
-	int   nChannels{ 1 };
+	float g{ 0.0f };
+	float h{ 1.0f };
+	float R2{ static_cast<float>(std::sqrt(2.0)) };
+	float frequency{ 0.0f };
 
-	LRFilter() {
-		filter.setType(juce::dsp::LinkwitzRileyFilterType::allpass);
-	}
+	float sampleRate{ DEFAULT_SR };
 
-	void setFrequency(T f) {
+	// Coefficients are only recomputed when the cutoff actually moves, and
+	// then with FastMath::tan: during a sweep this runs every sample.
+	void setFrequency(float f) {
+		if (f == frequency) return;
 		frequency = f;
-		filter.setCutoffFrequency(frequency);
+		updateCoefficients();
 	}
 
-	void prepare(float sr, float numSamples, int numChannels) {
+	void prepare(float sr) {
 		sampleRate = sr;
-		blockSize = numSamples;
-		nChannels = numChannels;
-		juce::dsp::ProcessSpec spec;
-		spec.sampleRate = sampleRate;
-		spec.maximumBlockSize = blockSize;
-		spec.numChannels = nChannels;
-
-		filter.prepare(spec);
+		updateCoefficients();
+		reset();
+	}
+
+	void reset() {
+		s1 = s2 = s3 = s4 = T{};
+	}
+
+	void processSample(T sample, T& sampleOutLow, T& sampleOutHigh) {
+		auto yH = (sample - s1 * (R2 + g) - s2) * h;
+
+		auto yB = yH * g + s1;
+		s1 = yH * g + yB;
+
+		auto yL = yB * g + s2;
+		s2 = yB * g + yL;
+
+		auto yH2 = (yL - s3 * (R2 + g) - s4) * h;
+
+		auto yB2 = yH2 * g + s3;
+		s3 = yH2 * g + yB2;
+
+		auto yL2 = yB2 * g + s4;
+		s4 = yB2 * g + yL2;
+
+		sampleOutLow = yL2;
+		sampleOutHigh = yL - yB * R2 + yH - yL2;
+	}
+
+	// Low plus high output of tuning, a second-order allpass with that
+	// crossover's phase response, run on this filter's state. The sum only
+	// depends on the first section, so s3 and s4 stay unused. Taking the
+	// coefficients from the crossover keeps the two in step while the
+	// cutoff moves, without computing them twice.
+	T processAllpass(T sample, const LRFilter& tuning) {
+		auto tunedG = tuning.g;
+		auto tunedH = tuning.h;
+		auto yH = (sample - s1 * (R2 + tunedG) - s2) * tunedH;
+
+		auto yB = yH * tunedG + s1;
+		s1 = yH * tunedG + yB;
+
+		auto yL = yB * tunedG + s2;
+		s2 = yB * tunedG + yL;
+
+		return yL - yB * R2 + yH;
 	}
 
-	void processSample(int ch, T sample, T& sampleOutLow, T& sampleOutHigh) {
-		filter.processSample(ch, sample, sampleOutLow, sampleOutHigh);
+private:
+	// FastMath::tan only holds below pi / 2, and the cutoffs go up to
+	// 20 kHz whatever the sample rate, so they stop short of Nyquist the
+	// way the linear-phase crossover's do.
+	void updateCoefficients() {
+		auto clamped = juce::jlimit(1.0f, 0.49f * sampleRate, frequency);
+		g = FastMath::tan(static_cast<float>(M_PI) * clamped / sampleRate);
+		h = 1.0f / (1.0f + R2 * g + g * g);
 	}
 };
 
 #undef DEFAULT_SR
-#undef M_PI
\ No newline at end of file
+#undef M_PI
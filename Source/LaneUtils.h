@@ -0,0 +1,101 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <cmath>
+#include "FastMath.h"
+#include "FilteredParameter.h"
+
+// One SIMD register worth of float lanes. Engines that run several
+// independent voices of the same math (bands, channels) keep one voice
+// per lane.
+using Lane = juce::dsp::SIMDRegister<float>;
+using LaneMask = Lane::vMaskType;
+
+// SIMDRegister has no division, rounding or transcendental functions.
+// These helpers apply a scalar function lane by lane through an aligned
+// array; the loops have a fixed trip count so the compiler can keep them
+// in vector registers where the target has a matching instruction.
+template <typename Fn>
+inline Lane laneMap(Lane a, Fn fn) {
+    alignas(sizeof(Lane)) float x[Lane::SIMDNumElements];
+    a.copyToRawArray(x);
+    for (size_t i = 0; i < Lane::SIMDNumElements; ++i) x[i] = fn(x[i]);
+    return Lane::fromRawArray(x);
+}
+
+template <typename Fn>
+inline Lane laneMap(Lane a, Lane b, Fn fn) {
+    alignas(sizeof(Lane)) float x[Lane::SIMDNumElements];
+    alignas(sizeof(Lane)) float y[Lane::SIMDNumElements];
+    a.copyToRawArray(x);
+    b.copyToRawArray(y);
+    for (size_t i = 0; i < Lane::SIMDNumElements; ++i) x[i] = fn(x[i], y[i]);
+    return Lane::fromRawArray(x);
+}
+
+inline Lane laneDivide(Lane a, Lane b) {
+    return laneMap(a, b, [](float x, float y) { return x / y; });
+}
+
+// base^exponent for base >= 0, see FastMath.h for the error per tier.
+template <FastMath::Accuracy A = FastMath::Accuracy::balanced>
+inline Lane lanePow(Lane base, Lane exponent) {
+    return laneMap(base, exponent, [](float x, float y) { return FastMath::pow<A>(x, y); });
+}
+
+template <FastMath::Accuracy A = FastMath::Accuracy::balanced>
+inline Lane laneLog2(Lane a) {
+    return laneMap(a, [](float x) { return FastMath::log2<A>(x); });
+}
+
+inline Lane laneTrunc(Lane a) {
+    return laneMap(a, [](float x) { return FastMath::trunc(x); });
+}
+
+inline Lane laneFloor(Lane a) {
+    return laneMap(a, [](float x) { return std::floor(x); });
+}
+
+// Magnitude of the first argument with the sign of the second. Zero counts
+// as positive, like sign() in Utils.h.
+inline Lane laneCopySign(Lane magnitude, Lane sign) {
+    return laneMap(magnitude, sign, [](float m, float s) { return s < 0.0f ? -m : m; });
+}
+
+// Lanes of a where the mask is set, lanes of b elsewhere.
+inline Lane laneSelect(LaneMask mask, Lane a, Lane b) {
+    return (a & mask) + (b & ~mask);
+}
+
+// Frame buffers are float arrays aligned to the register size with one
+// register per frame. This views them as registers, for code templated on
+// the sample type.
+inline Lane* asLanes(float* frames) {
+    jassert(reinterpret_cast<uintptr_t>(frames) % alignof(Lane) == 0);
+    return reinterpret_cast<Lane*>(frames);
+}
+
+// Per-lane counterpart of ParameterRamp: sample i of the control block
+// reads start + increment * i in every lane.
+struct LaneRamp
+{
+    Lane start = Lane::expand(1.0f);
+    Lane increment = Lane::expand(0.0f);
+
+    void set(size_t lane, ParameterRamp ramp) {
+        start.set(lane, ramp.start);
+        increment.set(lane, ramp.increment);
+    }
+
+    Lane operator[](int i) const {
+        return start + increment * static_cast<float>(i);
+    }
+
+    // The same trajectory read at 2^factor times the rate. Like the base
+    // ramp it ends exactly on the control block's last value.
+    LaneRamp stretched(int factor) const {
+        if (factor == 0) return *this;
+        auto step = increment * (1.0f / static_cast<float>(1 << factor));
+        return { start - increment + step, step };
+    }
+};
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "LaneUtils.h"
+#include "AlignedArena.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+
+// The convolution runs one partition of this many samples at a time,
+// which is also what it adds to the latency on top of half a kernel.
+#define CROSSOVER_PARTITION_ORDER 8
+#define CROSSOVER_PARTITION_SIZE (1 << CROSSOVER_PARTITION_ORDER)
+// Kernel length up to 48 kHz. It doubles with the sample rate, so the
+// frequency resolution and the latency in milliseconds stay about the same.
+#define CROSSOVER_KERNEL_ORDER 12
+
+// Linear-phase alternative to the Linkwitz-Riley crossover tree, as a
+// uniformly partitioned FFT convolution: overlap-save over partitions of
+// CROSSOVER_PARTITION_SIZE with a frequency-domain delay line of input
+// spectra. Every band shares the forward transform of the input and takes
+// one inverse transform per partition. The last band is the delayed input
+// minus all the others, so the bands always add back up to the input.
+// Spectra are kept split into real and imaginary parts, in registers, so
+// the multiply-accumulate over the partitions runs a register of bins at
+// a time. The imaginary parts of DC and Nyquist are always zero, which
+// leaves room for Nyquist's real part in DC's imaginary slot: a spectrum
+// is CROSSOVER_PARTITION_SIZE complex values, a whole number of registers.
+//
+// Band b of NumSplits + 1 passes what lies below cut b and above every
+// earlier cut, with the magnitude of the IIR tree (|LP| = 1 / (1 + r^4)
+// at the bilinear-prewarped frequency ratio r) and zero phase, centred on
+// half a kernel and windowed.
+//
+// Kernels are rebuilt off the audio thread when the cutoffs change, and
+// the audio thread fades from the old set to the new one over a
+// partition. The two kernel slots change hands like WaveshaperTableCache's
+// tables, except that the audio thread acknowledges a set only once the
+// partition fading away from the previous one is done. While it holds no
+// kernels at all, after reset() or release(), it acknowledges none, and
+// the builder is free to replace them as often as the cutoffs change.
+template <size_t NumSplits>
+class LinearPhaseCrossover
+{
+    struct Kernels
+    {
+        std::array<float, NumSplits> cuts{};
+        // Per band and partition, one spectrum.
+        ArenaArray<Lane> spectra;
+    };
+
+    float sampleRate{ 48000.0f };
+    int numChannels{ 0 };
+    int kernelSize{ 0 };
+    int numPartitions{ 0 };
+
+    // Audio thread. Per channel: the previous and the current partition of
+    // input, the delay line of input spectra (split like the kernels), a
+    // history of kernelSize input samples for the delayed input, and the
+    // output of the last partition for the delayed input and every band.
+    juce::dsp::FFT fft{ CROSSOVER_PARTITION_ORDER + 1 };
+    ArenaArray<float> fftBuffer, faded;
+    ArenaArray<Lane> spectra, accumulator;
+    ArenaArray<float> inputs, history, delayed, outputs;
+    int position{ 0 };
+    int spectrumPosition{ 0 };
+    int historyPosition{ 0 };
+    int activeKernels{ -1 };
+
+    std::array<Kernels, 2> kernels;
+    std::atomic<int> published{ -1 };
+    std::atomic<int> acknowledged{ -1 };
+    std::array<std::atomic<float>, NumSplits> requestedCuts{};
+
+    // Builder, with transforms of its own so it never shares one with the
+    // audio thread.
+    juce::dsp::FFT buildFFT{ CROSSOVER_PARTITION_ORDER + 1 };
+    std::unique_ptr<juce::dsp::FFT> kernelFFT;
+    ArenaArray<double> rest;
+    ArenaArray<float> window, kernelBuffer, kernel, partitionBuffer;
+
+    // Registers per spectrum, half of them real parts.
+    static int spectrumSize() { return 2 * CROSSOVER_PARTITION_SIZE / static_cast<int>(Lane::SIMDNumElements); }
+
+    // Transform output, interleaved as JUCE leaves it, into a spectrum.
+    static void split(const float* transformed, Lane* spectrum) {
+        auto* re = reinterpret_cast<float*>(spectrum);
+        auto* im = re + CROSSOVER_PARTITION_SIZE;
+        for (int k = 0; k < CROSSOVER_PARTITION_SIZE; ++k) {
+            re[k] = transformed[2 * k];
+            im[k] = transformed[2 * k + 1];
+        }
+        im[0] = transformed[2 * CROSSOVER_PARTITION_SIZE];
+    }
+
+    static void interleave(const Lane* spectrum, float* transformed) {
+        auto* re = reinterpret_cast<const float*>(spectrum);
+        auto* im = re + CROSSOVER_PARTITION_SIZE;
+        for (int k = 0; k < CROSSOVER_PARTITION_SIZE; ++k) {
+            transformed[2 * k] = re[k];
+            transformed[2 * k + 1] = im[k];
+        }
+        transformed[1] = 0.0f;
+        transformed[2 * CROSSOVER_PARTITION_SIZE] = im[0];
+        transformed[2 * CROSSOVER_PARTITION_SIZE + 1] = 0.0f;
+    }
+
+    float* getInput(int ch) { return inputs.data() + ch * 2 * CROSSOVER_PARTITION_SIZE; }
+    Lane* getSpectrum(int ch, int partition) { return spectra.data() + (ch * numPartitions + partition) * spectrumSize(); }
+    float* getHistory(int ch) { return history.data() + ch * kernelSize; }
+    float* getDelayed(int ch) { return delayed.data() + ch * CROSSOVER_PARTITION_SIZE; }
+    float* getOutput(int ch, int band) { return outputs.data() + (ch * (NumSplits + 1) + band) * CROSSOVER_PARTITION_SIZE; }
+
+    void build(Kernels& set, const std::array<float, NumSplits>& cuts) {
+        auto pi = juce::MathConstants<double>::pi;
+        auto half = kernelSize / 2;
+        std::fill(rest.begin(), rest.end(), 1.0);
+
+        for (size_t band = 0; band < NumSplits; ++band) {
+            auto cutoff = std::tan(pi * cuts[band] / sampleRate);
+            for (int k = 0; k <= half; ++k) {
+                auto r = std::tan(pi * k / kernelSize) / cutoff;
+                auto low = 1.0 / (1.0 + r * r * r * r);
+                kernelBuffer[2 * k] = static_cast<float>(rest[k] * low);
+                kernelBuffer[2 * k + 1] = 0.0f;
+                rest[k] *= 1.0 - low;
+            }
+            kernelFFT->performRealOnlyInverseTransform(kernelBuffer.data());
+
+            // The zero-phase response is centred on sample 0; move it to
+            // the middle of the kernel.
+            for (int m = 0; m < kernelSize; ++m) {
+                kernel[m] = kernelBuffer[(m + half) & (kernelSize - 1)] * window[m];
+            }
+
+            for (int partition = 0; partition < numPartitions; ++partition) {
+                std::fill(partitionBuffer.begin(), partitionBuffer.end(), 0.0f);
+                std::copy_n(kernel.data() + partition * CROSSOVER_PARTITION_SIZE, CROSSOVER_PARTITION_SIZE, partitionBuffer.data());
+                buildFFT.performRealOnlyForwardTransform(partitionBuffer.data(), true);
+                split(partitionBuffer.data(), set.spectra.data() + (band * numPartitions + partition) * spectrumSize());
+            }
+        }
+        set.cuts = cuts;
+    }
+
+    // One band of the partition just completed, through the kernels of set.
+    void convolve(int ch, const Kernels& set, int band, float* output) {
+        auto half = spectrumSize() / 2;
+        auto* re = accumulator.data();
+        auto* im = re + half;
+        std::fill(accumulator.begin(), accumulator.end(), Lane::expand(0.0f));
+        auto dc = 0.0f, nyquist = 0.0f;
+
+        for (int partition = 0; partition < numPartitions; ++partition) {
+            auto* x = getSpectrum(ch, (spectrumPosition + numPartitions - partition) % numPartitions);
+            auto* h = set.spectra.data() + (band * numPartitions + partition) * spectrumSize();
+            dc += x[0].get(0) * h[0].get(0);
+            nyquist += x[half].get(0) * h[half].get(0);
+            for (int i = 0; i < half; ++i) {
+                re[i] += x[i] * h[i] - x[half + i] * h[half + i];
+                im[i] += x[i] * h[half + i] + x[half + i] * h[i];
+            }
+        }
+        re[0].set(0, dc);
+        im[0].set(0, nyquist);
+
+        interleave(accumulator.data(), fftBuffer.data());
+        fft.performRealOnlyInverseTransform(fftBuffer.data());
+        std::copy_n(fftBuffer.data() + CROSSOVER_PARTITION_SIZE, CROSSOVER_PARTITION_SIZE, output);
+    }
+
+    void processPartition(int channels, int numBands) {
+        auto index = published.load(std::memory_order_acquire);
+        auto fade = activeKernels >= 0 && activeKernels != index;
+        auto last = numBands - 1;
+
+        for (int ch = 0; ch < channels; ++ch) {
+            auto* input = getInput(ch);
+            std::copy_n(input, 2 * CROSSOVER_PARTITION_SIZE, fftBuffer.data());
+            fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+            split(fftBuffer.data(), getSpectrum(ch, spectrumPosition));
+
+            auto* past = getHistory(ch);
+            auto* dry = getDelayed(ch);
+            for (int i = 0; i < CROSSOVER_PARTITION_SIZE; ++i) {
+                past[(historyPosition + i) & (kernelSize - 1)] = input[CROSSOVER_PARTITION_SIZE + i];
+            }
+            for (int i = 0; i < CROSSOVER_PARTITION_SIZE; ++i) {
+                dry[i] = past[(historyPosition + i - kernelSize / 2) & (kernelSize - 1)];
+            }
+            std::copy_n(input + CROSSOVER_PARTITION_SIZE, CROSSOVER_PARTITION_SIZE, input);
+
+            if (numBands == 0) {
+                std::fill_n(getOutput(ch, 0), (NumSplits + 1) * CROSSOVER_PARTITION_SIZE, 0.0f);
+                continue;
+            }
+
+            auto* remainder = getOutput(ch, last);
+            std::copy_n(dry, CROSSOVER_PARTITION_SIZE, remainder);
+            for (int band = 0; band < last; ++band) {
+                auto* output = getOutput(ch, band);
+                if (index < 0) {
+                    std::fill_n(output, CROSSOVER_PARTITION_SIZE, 0.0f);
+                    continue;
+                }
+
+                convolve(ch, kernels[index], band, output);
+                if (fade) {
+                    convolve(ch, kernels[activeKernels], band, faded.data());
+                    for (int i = 0; i < CROSSOVER_PARTITION_SIZE; ++i) {
+                        auto amount = static_cast<float>(i + 1) / CROSSOVER_PARTITION_SIZE;
+                        output[i] = faded[i] + (output[i] - faded[i]) * amount;
+                    }
+                }
+                for (int i = 0; i < CROSSOVER_PARTITION_SIZE; ++i) remainder[i] -= output[i];
+            }
+        }
+
+        historyPosition = (historyPosition + CROSSOVER_PARTITION_SIZE) & (kernelSize - 1);
+        spectrumPosition = (spectrumPosition + 1) % numPartitions;
+        activeKernels = index;
+        acknowledged.store(index, std::memory_order_release);
+    }
+
+public:
+
+    // Sizes everything for the sample rate and drops any kernels built
+    // before. The buffers come from allocate() after that.
+    void prepare(float newSampleRate, int channels) {
+        sampleRate = newSampleRate;
+        numChannels = channels;
+
+        auto order = CROSSOVER_KERNEL_ORDER;
+        while ((1 << order) < (1 << CROSSOVER_KERNEL_ORDER) * sampleRate / 48000.0f) ++order;
+        kernelSize = 1 << order;
+        numPartitions = kernelSize / CROSSOVER_PARTITION_SIZE;
+        kernelFFT = std::make_unique<juce::dsp::FFT>(order);
+
+        published.store(-1, std::memory_order_release);
+        acknowledged.store(-1, std::memory_order_release);
+    }
+
+    // Takes the buffers for what prepare() sized from arena, the kernels
+    // and the builder's included. Part of the owner's arena layout.
+    void allocate(AlignedArena& arena) {
+        fftBuffer = arena.take<float>(4 * CROSSOVER_PARTITION_SIZE);
+        accumulator = arena.take<Lane>(spectrumSize());
+        faded = arena.take<float>(CROSSOVER_PARTITION_SIZE);
+        inputs = arena.take<float>(numChannels * 2 * CROSSOVER_PARTITION_SIZE);
+        spectra = arena.take<Lane>(numChannels * numPartitions * spectrumSize());
+        history = arena.take<float>(numChannels * kernelSize);
+        delayed = arena.take<float>(numChannels * CROSSOVER_PARTITION_SIZE);
+        outputs = arena.take<float>(numChannels * (NumSplits + 1) * CROSSOVER_PARTITION_SIZE);
+
+        for (auto& set : kernels) set.spectra = arena.take<Lane>(NumSplits * numPartitions * spectrumSize());
+
+        rest = arena.take<double>(kernelSize / 2 + 1);
+        kernelBuffer = arena.take<float>(2 * kernelSize);
+        kernel = arena.take<float>(kernelSize);
+        partitionBuffer = arena.take<float>(4 * CROSSOVER_PARTITION_SIZE);
+        window = arena.take<float>(kernelSize);
+        if (arena.isMeasuring()) return;
+
+        // Periodic Blackman, exactly 1 at the centre tap so the bands still
+        // sum to the delayed input.
+        for (int m = 0; m < kernelSize; ++m) {
+            auto phase = juce::MathConstants<double>::twoPi * m / kernelSize;
+            window[m] = static_cast<float>(0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase));
+        }
+
+        reset();
+    }
+
+    // Clears the signal state; the kernels stay.
+    void reset() {
+        std::fill(inputs.begin(), inputs.end(), 0.0f);
+        std::fill(spectra.begin(), spectra.end(), Lane::expand(0.0f));
+        std::fill(history.begin(), history.end(), 0.0f);
+        std::fill(delayed.begin(), delayed.end(), 0.0f);
+        std::fill(outputs.begin(), outputs.end(), 0.0f);
+        position = 0;
+        spectrumPosition = 0;
+        historyPosition = 0;
+        release();
+    }
+
+    // The audio thread is done with the kernels until it next processes:
+    // it picks up whatever set is published then, without a fade. Call
+    // when the owner stops running the convolution.
+    void release() {
+        activeKernels = -1;
+        acknowledged.store(-1, std::memory_order_release);
+    }
+
+    // Gives channel to the signal state of channel from.
+    void copyChannel(int from, int to) {
+        std::copy_n(getInput(from), 2 * CROSSOVER_PARTITION_SIZE, getInput(to));
+        std::copy_n(getSpectrum(from, 0), numPartitions * spectrumSize(), getSpectrum(to, 0));
+        std::copy_n(getHistory(from), kernelSize, getHistory(to));
+        std::copy_n(getDelayed(from), CROSSOVER_PARTITION_SIZE, getDelayed(to));
+        std::copy_n(getOutput(from, 0), (NumSplits + 1) * CROSSOVER_PARTITION_SIZE, getOutput(to, 0));
+    }
+
+    // Cutoffs in Hz for the next kernels, from any thread.
+    void request(const std::array<float, NumSplits>& cuts) {
+        for (size_t split = 0; split < NumSplits; ++split) {
+            requestedCuts[split].store(cuts[split], std::memory_order_relaxed);
+        }
+    }
+
+    // Builds kernels for the requested cutoffs if they changed. Call from
+    // a background or message thread, never from the audio thread.
+    // Cutoffs are kept between 1 Hz and 0.49 fs and never below the
+    // previous one, like the IIR tree's.
+    void rebuild() {
+        if (kernelFFT == nullptr) return;
+
+        std::array<float, NumSplits> cuts;
+        for (size_t split = 0; split < NumSplits; ++split) {
+            auto cut = juce::jlimit(1.0f, 0.49f * sampleRate, requestedCuts[split].load(std::memory_order_relaxed));
+            cuts[split] = split == 0 ? cut : std::max(cut, cuts[split - 1]);
+        }
+
+        auto current = published.load(std::memory_order_acquire);
+        if (current >= 0 && kernels[current].cuts == cuts) return;
+        auto held = acknowledged.load(std::memory_order_acquire);
+        if (held >= 0 && held != current) return;
+
+        auto next = current == 0 ? 1 : 0;
+        build(kernels[next], cuts);
+        published.store(next, std::memory_order_release);
+    }
+
+    // Takes numSamples of every channel in samples and replaces them with
+    // the input delayed by getLatency(). The bands of the same samples go
+    // to output(ch, band, offset, bandSamples, n), a chunk at a time.
+    // With no bands it only delays, but keeps the delay line of spectra
+    // current so the bands can come back without a gap. They come back
+    // silent for the rest of the partition.
+    template <typename Output>
+    void process(float* const* samples, int channels, int numSamples, int numBands, Output&& output) {
+        jassert(channels <= numChannels);
+        jassert(numBands >= 0 && numBands <= static_cast<int>(NumSplits) + 1);
+
+        for (int offset = 0; offset < numSamples;) {
+            auto n = std::min(numSamples - offset, CROSSOVER_PARTITION_SIZE - position);
+
+            for (int ch = 0; ch < channels; ++ch) {
+                std::copy_n(samples[ch] + offset, n, getInput(ch) + CROSSOVER_PARTITION_SIZE + position);
+                std::copy_n(getDelayed(ch) + position, n, samples[ch] + offset);
+                for (int band = 0; band < numBands; ++band) {
+                    output(ch, band, offset, getOutput(ch, band) + position, n);
+                }
+            }
+
+            offset += n;
+            position += n;
+            if (position == CROSSOVER_PARTITION_SIZE) {
+                processPartition(channels, numBands);
+                position = 0;
+            }
+        }
+    }
+
+    // In samples: one partition to collect the input, half a kernel to
+    // the centre tap.
+    int getLatency() const {
+        return CROSSOVER_PARTITION_SIZE + kernelSize / 2;
+    }
+
+    // In samples after the last input: the latency and the other half of
+    // the kernel.
+    int getTailLength() const {
+        return CROSSOVER_PARTITION_SIZE + kernelSize;
+    }
+
+};
@@ -1,141 +1,1037 @@
 #include "MultibandDistortion.h"
 
+template <InstructionSet Set, size_t... Index>
+LaneDistortion::KernelTable LaneDistortion::makeKernels(std::index_sequence<Index...>) {
+	return { &LaneDistortion::processKernel<Set, Index % KERNEL_COUNT, Index / KERNEL_COUNT>... };
+}
 
-void Distortion::prepare(DSPParameters<float>& params) {
-	sampleRate = params["sampleRate"];
-	blockSize = params["blockSize"];
-	nChannels = params["nChannels"];
+const std::array<LaneDistortion::KernelTable, INSTRUCTION_SET_COUNT> LaneDistortion::kernels = {
+	LaneDistortion::makeKernels<InstructionSet::sse2>(std::make_index_sequence<KERNEL_COUNT * (MIXED_CURVES + 1)>()),
+	LaneDistortion::makeKernels<InstructionSet::avx2>(std::make_index_sequence<KERNEL_COUNT * (MIXED_CURVES + 1)>()),
+	LaneDistortion::makeKernels<InstructionSet::avx512>(std::make_index_sequence<KERNEL_COUNT * (MIXED_CURVES + 1)>())
+};
 
+void BandDistortion::prepare(float sampleRate) {
 	inputGain.prepare(sampleRate);
 	outputGain.prepare(sampleRate);
 	drive.prepare(sampleRate);
-	mix.prepare(sampleRate);
 	knee.prepare(sampleRate);
 }
 
-void Distortion::update(DSPParameters<float>& params) {
-	inputGain.update(dbToLinear(params["inputGain"]));
-	outputGain.update(dbToLinear(params["outputGain"]));
-	drive.update(dbToLinear(params["drive"]));
-	knee.update(params["knee"]);
-	bit = static_cast<int>(params["bit"]);
-	mix.update(params["mix"] * 0.01f);
+void BandDistortion::update(DSPParameters<float>& params, int band) {
+	auto& keys = getParameterKeys();
+	auto& bandKeys = keys.band[band];
+	inputGain.update(dbToLinear(params[bandKeys.inputGain]));
+	outputGain.update(dbToLinear(params[bandKeys.outputGain]));
+	drive.update(dbToLinear(params[bandKeys.drive]));
+	knee.update(params[bandKeys.knee]);
+	bit = static_cast<int>(params[bandKeys.bit]);
+	curve = juce::jlimit(0, CURVE_COUNT - 1, static_cast<int>(params[bandKeys.curve]));
+	useTables = params[keys.tableShaper] > 0.5f || params[keys.antialias] > 0.5f;
 }
 
-void Distortion::processBlock(float* const* inputBuffer, int numChannels, int numSamples) {
-	for (int ch = 0; ch < numChannels; ++ch) {
-		for (auto s = 0; s < numSamples; ++s) {
-			auto sample = inputBuffer[ch][s];
-			inputBuffer[ch][s] = processSample(sample);
+void BandDistortion::reset() {
+	inputGain.reset();
+	outputGain.reset();
+	drive.reset();
+	knee.reset();
+}
+
+// Pull one control block worth of ramps out of the smoothers. The knee
+// only matters on the variable curve, and only there is a table wanted.
+void BandDistortion::advance(int numSamples) {
+	inputGainRamp = inputGain.ramp(numSamples);
+	outputGainRamp = outputGain.ramp(numSamples);
+	driveRamp = drive.ramp(numSamples);
+	kneeRamp = knee.ramp(numSamples);
+	table = nullptr;
+	if (!useTables || curve != VARIABLE_CURVE) return;
+
+	tableCache.request(knee.read());
+	auto* candidate = tableCache.acquire();
+	if (candidate != nullptr && kneeRamp.isConstant() && candidate->knee == kneeRamp.start) table = candidate;
+}
+
+void BandDistortion::rebuildTable() {
+	tableCache.rebuild();
+}
+
+void LaneDistortion::prepare(const std::array<int, BAND_GROUP_SIZE>& laneBands, InstructionSet instructionSet) {
+	bands = laneBands;
+	kernelTable = &kernels[static_cast<int>(instructionSet)];
+}
+
+// Lanes from the first one whose band is not in use on have none either.
+void LaneDistortion::update(DSPParameters<float>& params, const BandSettings& settings) {
+	auto numBands = getBandCount(params);
+	numLanes = 0;
+	while (numLanes < BAND_GROUP_SIZE && bands[numLanes] < numBands) ++numLanes;
+
+	bandMask = LaneMask::expand(0);
+	crushMask = LaneMask::expand(0);
+	for (int lane = 0; lane < numLanes; ++lane) {
+		auto bit = settings[bands[lane]].bit;
+		// exp2 of an integer is exact, so the step matches 2 / (2^bit - 1).
+		auto levels = FastMath::exp2<FastMath::Accuracy::precise>(static_cast<float>(bit)) - 1.0f;
+		quantizationStep.set(lane, 2.0f / levels);
+		inverseQuantizationStep.set(lane, 0.5f * levels);
+		bandMask.set(lane, ~0u);
+		crushMask.set(lane, bit < 32 ? ~0u : 0u);
+	}
+	antialias = params[getParameterKeys().antialias] > 0.5f;
+}
+
+void LaneDistortion::reset() {
+	antialiasStates.fill({});
+}
+
+void LaneDistortion::copyState(const LaneDistortion& other) {
+	antialiasStates = other.antialiasStates;
+}
+
+// Gather one control block worth of parameter ramps into the lanes.
+// processFrame() then reads sample `index` of the current block from them.
+// Lanes outside active keep whatever they had; processBlock() never writes
+// them back.
+// A stage is only skipped when its ramps are constant at the neutral value
+// in every active lane, so the kernel choice never changes the output
+// mid-ramp. The knee only matters for lanes on the variable curve.
+void LaneDistortion::advance(const BandSettings& settings, LaneMask active) {
+	tableMask = LaneMask::expand(0);
+	numTableLanes = 0;
+	numActiveLanes = 0;
+	activeTables.fill(nullptr);
+	curvesInUse = 0;
+	for (auto& mask : curveMasks) mask = LaneMask::expand(0);
+	auto kernelFlags = KNEE_ONE | NO_CRUSH | (antialias ? ANTIALIAS : 0);
+	unityGain = true;
+
+	for (int lane = 0; lane < numLanes; ++lane) {
+		if (active.get(lane) == 0) continue;
+
+		auto& band = settings[bands[lane]];
+		++numActiveLanes;
+		inputGainRamp.set(lane, band.inputGainRamp);
+		outputGainRamp.set(lane, band.outputGainRamp);
+		controlRamps.drive.set(lane, band.driveRamp);
+		controlRamps.knee.set(lane, band.kneeRamp);
+
+		curveMasks[band.curve].set(lane, ~0u);
+		curvesInUse |= 1 << band.curve;
+
+		if (band.curve == VARIABLE_CURVE && (!band.kneeRamp.isConstant() || band.kneeRamp.start != 1.0f)) kernelFlags &= ~KNEE_ONE;
+		if (band.bit < 32) kernelFlags &= ~NO_CRUSH;
+		if (!band.inputGainRamp.isConstant() || band.inputGainRamp.start != 1.0f
+			|| !band.outputGainRamp.isConstant() || band.outputGainRamp.start != 1.0f) unityGain = false;
+
+		if (band.table != nullptr) {
+			activeTables[lane] = band.table;
+			tableMask.set(lane, ~0u);
+			++numTableLanes;
+		}
+	}
+
+	integralMask = (kernelFlags & KNEE_ONE) ? bandMask : (tableMask | ~curveMasks[VARIABLE_CURVE]) & bandMask;
+
+	int blockCurve = MIXED_CURVES;
+	for (int c = 0; c < CURVE_COUNT; ++c) {
+		if (curvesInUse == 1 << c) blockCurve = c;
+	}
+	kernelIndex = kernelFlags + KERNEL_COUNT * blockCurve;
+}
+
+// Lanes without a band are weighted out of the sum, whatever their gain.
+void LaneDistortion::applyInputGain(float* frames, int numFrames) {
+	if (unityGain) return;
+
+	for (int s = 0; s < numFrames; ++s) {
+		auto* frame = frames + s * Lane::SIMDNumElements;
+		(Lane::fromRawArray(frame) * inputGainRamp[s]).copyToRawArray(frame);
+	}
+}
+
+void LaneDistortion::applyOutputGain(float* frames, int numFrames) {
+	if (unityGain) return;
+
+	for (int s = 0; s < numFrames; ++s) {
+		auto* frame = frames + s * Lane::SIMDNumElements;
+		(Lane::fromRawArray(frame) * outputGainRamp[s]).copyToRawArray(frame);
+	}
+}
+
+void LaneDistortion::processBlock(float* frames, int numFrames, int factor, LaneMask lanes) {
+	writeMask = lanes & bandMask;
+	ramps.drive = controlRamps.drive.stretched(factor);
+	ramps.knee = controlRamps.knee.stretched(factor);
+	antialiasState = &antialiasStates[factor];
+	(this->*(*kernelTable)[kernelIndex])(frames, numFrames);
+}
+
+template <InstructionSet Set, int Flags, int Curve>
+void LaneDistortion::processKernel(float* frames, int numFrames) {
+	CpuDispatch::run<Set>([&] {
+		if constexpr (Flags & ANTIALIAS) {
+			antialiasState->integral = integral<Flags, Curve>(antialiasState->input);
 		}
+
+		for (int s = 0; s < numFrames; ++s) {
+			auto* frame = frames + s * Lane::SIMDNumElements;
+			processFrame<Flags, Curve>(Lane::fromRawArray(frame), s).copyToRawArray(frame);
+		}
+	});
+}
+
+template <int Flags, int Curve>
+inline Lane LaneDistortion::processFrame(Lane frame, int index) {
+	auto driven = frame * ramps.drive[index];
+	Lane output;
+
+	if constexpr (Flags & ANTIALIAS) {
+		output = shapeAntialiased<Flags, Curve>(driven, index);
+		auto delayed = antialiasState->halfSample.process(output);
+		if constexpr (Flags & NO_CRUSH) output = delayed;
+		else output = laneSelect(crushMask, bitcrushAntialiased(output), delayed);
 	}
+	else {
+		output = shape<Flags, Curve>(driven, index);
+		if constexpr (!(Flags & NO_CRUSH)) output = bitcrush(output);
+	}
+	output = limit(output);
+	return laneSelect(writeMask, output, frame);
+}
+
+template <int Flags, int Curve>
+inline Lane LaneDistortion::shape(Lane driven, int index) {
+	if constexpr (Curve == MIXED_CURVES) return shapeMixed<Flags>(driven, index);
+	else if constexpr (Curve == VARIABLE_CURVE) return shapeVariable<Flags>(driven, index);
+	else return ShaperCurve<Curve>::apply(driven);
+}
+
+// Bands on different curves: every curve in use shapes the whole register
+// and keeps its own lanes. Which curves run is fixed for the block.
+template <int Flags, int Curve>
+inline Lane LaneDistortion::shapeMixed(Lane driven, int index) {
+	auto output = Lane::expand(0.0f);
+	if (curvesInUse & (1 << Curve)) output = shape<Flags, Curve>(driven, index) & curveMasks[Curve];
+	if constexpr (Curve + 1 < CURVE_COUNT) output += shapeMixed<Flags, Curve + 1>(driven, index);
+	return output;
+}
+
+template <int Flags>
+inline Lane LaneDistortion::shapeVariable(Lane driven, int index) {
+	if constexpr (Flags & KNEE_ONE) {
+		return clipUnitKnee(driven);
+	}
+	else if (numTableLanes == 0) {
+		return clip(driven, ramps.knee[index]);
+	}
+	else if (numTableLanes == numActiveLanes) {
+		return clipTable(driven);
+	}
+	else {
+		return laneSelect(tableMask, clipTable(driven), clip(driven, ramps.knee[index]));
+	}
+}
+
+// First-order ADAA: the mean of the curve between the previous and the
+// current input, which is half a sample late.
+template <int Flags, int Curve>
+inline Lane LaneDistortion::shapeAntialiased(Lane driven, int index) {
+	auto& state = *antialiasState;
+	auto current = integral<Flags, Curve>(driven);
+	auto delta = driven - state.input;
+	auto tolerance = Lane::max(Lane::abs(driven), Lane::expand(1.0f)) * ADAA_TOLERANCE;
+	auto useIntegral = integralMask & ~Lane::lessThan(Lane::abs(delta), tolerance);
+
+	auto averaged = laneDivide(current - state.integral, laneSelect(useIntegral, delta, Lane::expand(1.0f)));
+	auto midpoint = shape<Flags, Curve>((driven + state.input) * 0.5f, index);
+
+	state.input = driven;
+	state.integral = current;
+	return laneSelect(useIntegral, averaged, midpoint);
 }
 
-float Distortion::processSample(float sample) {
-	float output = clip(sample * inputGain.next(), drive.next(), knee.next());
-	output = bitcrush(output, bit);
-	return limit(output) * outputGain.next();
+template <int Flags, int Curve>
+inline Lane LaneDistortion::integral(Lane driven) {
+	if constexpr (Curve == MIXED_CURVES) return integralMixed<Flags>(driven);
+	else if constexpr (Curve == VARIABLE_CURVE) return integralVariable<Flags>(driven);
+	else return ShaperCurve<Curve>::integral(driven);
 }
 
+template <int Flags, int Curve>
+inline Lane LaneDistortion::integralMixed(Lane driven) {
+	auto output = Lane::expand(0.0f);
+	if (curvesInUse & (1 << Curve)) output = integral<Flags, Curve>(driven) & curveMasks[Curve];
+	if constexpr (Curve + 1 < CURVE_COUNT) output += integralMixed<Flags, Curve + 1>(driven);
+	return output;
+}
 
-float Distortion::bitcrush(float sample, int bit) {
-	float QL = 2.0 / (pow(2.0, bit) - 1.0);
-	return QL * static_cast<int>(sample / QL);
+// Lanes without a table give 0 here and are left out of integralMask.
+template <int Flags>
+inline Lane LaneDistortion::integralVariable(Lane driven) {
+	if constexpr (Flags & KNEE_ONE) {
+		// Integral of x / (1 + 0.28 x^2) is ln(1 + 0.28 x^2) / 0.56.
+		auto clamped = Lane::min(Lane::max(driven, Lane::expand(-1.0e18f)), Lane::expand(1.0e18f));
+		return laneLog2<FastMath::Accuracy::precise>(clamped * clamped * 0.28f + 1.0f) * static_cast<float>(0.69314718055994531 / 0.56);
+	}
+	else {
+		alignas(sizeof(Lane)) float x[Lane::SIMDNumElements];
+		driven.copyToRawArray(x);
+		for (int lane = 0; lane < BAND_GROUP_SIZE; ++lane) {
+			x[lane] = activeTables[lane] != nullptr ? activeTables[lane]->lookupIntegral(x[lane]) : 0.0f;
+		}
+		return Lane::fromRawArray(x);
+	}
+}
 
+Lane LaneDistortion::bitcrush(Lane sample) {
+	return laneSelect(crushMask, quantizationStep * laneTrunc(sample * inverseQuantizationStep), sample);
+}
+
+// ADAA of the staircase, worked out in units of one step in double: the
+// integer parts of the antiderivative are summed exactly as integers, so
+// the difference keeps its precision even at high bit depths.
+Lane LaneDistortion::bitcrushAntialiased(Lane sample) {
+	alignas(sizeof(Lane)) float current[Lane::SIMDNumElements];
+	alignas(sizeof(Lane)) float previous[Lane::SIMDNumElements];
+	(sample * inverseQuantizationStep).copyToRawArray(current);
+	(antialiasState->crushInput * inverseQuantizationStep).copyToRawArray(previous);
+	antialiasState->crushInput = sample;
+
+	for (int lane = 0; lane < numLanes; ++lane) {
+		auto u1 = static_cast<double>(current[lane]);
+		auto u0 = static_cast<double>(previous[lane]);
+		if (std::abs(u1 - u0) < ADAA_TOLERANCE) {
+			current[lane] = std::trunc(static_cast<float>(0.5 * (u0 + u1)));
+			continue;
+		}
+		// Integral of trunc(u) from 0 to |u| is n (n - 1) / 2 + n (|u| - n), n = floor(|u|).
+		auto n1 = std::floor(std::abs(u1));
+		auto n0 = std::floor(std::abs(u0));
+		auto whole = static_cast<int64_t>(n1) * (static_cast<int64_t>(n1) - 1) / 2 - static_cast<int64_t>(n0) * (static_cast<int64_t>(n0) - 1) / 2;
+		auto difference = static_cast<double>(whole) + n1 * (std::abs(u1) - n1) - n0 * (std::abs(u0) - n0);
+		current[lane] = static_cast<float>(difference / (u1 - u0));
+	}
+	return laneSelect(crushMask, quantizationStep * Lane::fromRawArray(current), sample);
 }
 
 // https://www.musicdsp.org/en/latest/Effects/104-variable-hardness-clipping-function.html
-float Distortion::clip(float input, float drive, float knee) {
-	input *= drive;
-	return sign(input) * pow(fastatan(pow(fabs(input), knee)), (1.0f / knee));
+Lane LaneDistortion::clip(Lane driven, Lane curveKnee) {
+	auto shaped = lanePow(Lane::abs(driven), curveKnee);
+	// Past 1e18 fastatan(u) is ~1 / (0.28 u) anyway; without the clamp a
+	// large drive and knee overflow u * u and inf / inf turns into NaN.
+	shaped = Lane::min(shaped, Lane::expand(1.0e18f));
+	shaped = laneDivide(shaped, shaped * shaped * 0.28f + 1.0f);
+	shaped = lanePow(shaped, laneDivide(Lane::expand(1.0f), curveKnee));
+	return laneCopySign(shaped, driven);
+}
+
+// clip() with knee 1: x / (1 + 0.28 x^2), which is odd, so no sign handling.
+Lane LaneDistortion::clipUnitKnee(Lane driven) {
+	auto clamped = Lane::min(Lane::max(driven, Lane::expand(-1.0e18f)), Lane::expand(1.0e18f));
+	return laneDivide(clamped, clamped * clamped * 0.28f + 1.0f);
+}
+
+// Same curve as clip(), read from the band's table for lanes that have one.
+Lane LaneDistortion::clipTable(Lane driven) {
+	alignas(sizeof(Lane)) float x[Lane::SIMDNumElements];
+	driven.copyToRawArray(x);
+
+	for (int lane = 0; lane < BAND_GROUP_SIZE; ++lane) {
+		if (activeTables[lane] != nullptr) {
+			x[lane] = activeTables[lane]->lookup(x[lane]);
+		}
+	}
+	return Lane::fromRawArray(x);
 }
 
-float Distortion::limit(float sample) {
-	if (sample > 4.0f) return 4.0f;
-	if (sample < -4.0f) return -4.0f;
-	return sample;
+Lane LaneDistortion::limit(Lane sample) {
+	return Lane::min(Lane::max(sample, Lane::expand(-4.0f)), Lane::expand(4.0f));
 }
 
 void MultibandDistortion::prepare(DSPParameters<float>& params) {
-	sampleRate = params["sampleRate"];
-	blockSize = params["blockSize"];
-	nChannels = params["nChannels"];
+	auto& keys = getParameterKeys();
+	sampleRate = params[keys.sampleRate];
+	blockSize = params[keys.blockSize];
+	nChannels = params[keys.nChannels];
 
-	lowDist.prepare(params);
-	midDist.prepare(params);
-	highDist.prepare(params);
+	instructionSet = CpuDispatch::getInstructionSet();
+	CpuDispatch::select(instructionSet, [this](auto set) {
+		splitStage = &MultibandDistortion::splitDry<decltype(set)::value>;
+		shapeStage = &MultibandDistortion::shapeBands<decltype(set)::value>;
+	});
+	for (auto& band : bandDistortions) band.prepare(sampleRate);
+
+	jassert(nChannels <= MAX_CHANNELS);
+	channelCount = juce::jlimit(1, MAX_CHANNELS, static_cast<int>(nChannels));
+	channelGroups = (channelCount + CHANNEL_GROUP_SIZE - 1) / CHANNEL_GROUP_SIZE;
+	registerCount = channelCount * BAND_GROUPS;
+	packChannels = channelCount > 2;
+
+	linearCrossover.prepare(sampleRate, channelCount);
+	arena.prepare([this](AlignedArena& layout) { allocate(layout); });
+
+	for (int slot = 0; slot < registerCount * BAND_GROUP_SIZE; ++slot) {
+		auto r = slot / BAND_GROUP_SIZE;
+		auto lane = slot % BAND_GROUP_SIZE;
+		registerBands[r][lane] = packChannels ? slot / channelCount : slot % MAX_BANDS;
+		registerChannels[r][lane] = packChannels ? slot % channelCount : slot / MAX_BANDS;
+		jassert(getSlot(registerBands[r][lane], registerChannels[r][lane]) == slot);
+	}
+	for (int r = 0; r < registerCount; ++r) distortions[r].prepare(registerBands[r], instructionSet);
+
+	resamplerDesign = params[keys.linearPhase] > 0.5f ? ResamplerDesign::linearPhase : ResamplerDesign::minimumPhase;
+	shaperDelay = params[keys.antialias] > 0.5f ? 1 : 0;
+	for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) {
+		for (int r = 0; r < registerCount; ++r) getResampler(factor, r).prepare(factor, resamplerDesign, shaperDelay);
+	}
+	previousFactors.fill(0);
+	bypassed = false;
+	silentSamples = 0;
+	idle = false;
+	identicalSamples = 0;
+	dualMono = false;
+	compensationPosition = 0;
+	numBands = 0;
+
+	for (auto& filter : splitFilters) filter.prepare(sampleRate);
+	linearPhaseCrossover = false;
+
+	inputGain.prepare(sampleRate);
+	outputGain.prepare(sampleRate);
+	mix.prepare(sampleRate);
+	for (auto& cut : crossoverCuts) cut.prepare(sampleRate);
 
-	lowMidFilter.prepare(sampleRate, blockSize, nChannels);
-	midHighFilter.prepare(sampleRate, blockSize, nChannels);
-	lowMidCut.update(params["lowMidCut"]);
-	midHighCut.update(params["midHighCut"]);
+	for (int band = 0; band < MAX_BANDS; ++band) {
+		bandEnabled[band].prepare(sampleRate, 1.0f - params[keys.band[band].bypass]);
+	}
+	allEnabled.prepare(sampleRate, 1.0f - params[keys.bypass]);
 
 	update(params);
+	// Build the first kernels right away, so the crossover never runs without.
+	linearCrossover.rebuild();
+
+	// Start from the prepared values instead of gliding up from zero.
+	for (auto& band : bandDistortions) band.reset();
+	inputGain.reset();
+	outputGain.reset();
+	mix.reset();
+	for (auto& cut : crossoverCuts) cut.reset();
+}
+
+// Both passes of the arena layout. The second one leaves every buffer
+// and state zeroed.
+void MultibandDistortion::allocate(AlignedArena& layout) {
+	distortions = layout.take<LaneDistortion>(registerCount);
+	bandFrames = layout.take<float>(channelCount * BAND_FRAMES);
+	dryFrames = layout.take<float>(channelCount * CONTROL_BLOCK_SIZE);
+	oversampledFrames = layout.take<float>(OVERSAMPLED_FRAMES);
+	compensationFrames = layout.take<float>(channelCount * COMPENSATION_FRAMES);
+	dryHistory = layout.take<float>(channelCount * COMPENSATION_SIZE);
+	splitFilters = layout.take<LRFilter<Lane>>((MAX_BANDS - 1) * channelGroups);
+	allpassFilters = layout.take<LRFilter<Lane>>((MAX_BANDS - 1) * registerCount);
+	resamplers = layout.take<Resampler<Lane>>(MAX_OVERSAMPLING_FACTOR * registerCount);
+	linearCrossover.allocate(layout);
 }
 
+// Splits and bands that have just come into use start settled at their
+// settings, like the bands' own smoothers: while out of use nothing
+// advanced them, so they would glide in from wherever they were left.
 void MultibandDistortion::update(DSPParameters<float>& params) {
+	auto& keys = getParameterKeys();
+	auto previousBands = numBands;
+
 	// Band specific parameters
-	lowParams.set("inputGain", params["inputGain1"]);
-	lowParams.set("outputGain", params["outputGain1"]);
-	lowParams.set("drive", params["drive1"]);
-	lowParams.set("knee", params["knee1"]);
-	lowParams.set("bit", params["bit1"]);
-	lowParams.set("bypass", params["bypass1"]);
-	lowDist.update(lowParams);
-	midParams.set("inputGain", params["inputGain2"]);
-	midParams.set("outputGain", params["outputGain2"]);
-	midParams.set("drive", params["drive2"]);
-	midParams.set("knee", params["knee2"]);
-	midParams.set("bit", params["bit2"]);
-	midParams.set("bypass", params["bypass2"]);
-	midDist.update(midParams);
-	highParams.set("inputGain", params["inputGain3"]);
-	highParams.set("outputGain", params["outputGain3"]);
-	highParams.set("drive", params["drive3"]);
-	highParams.set("knee", params["knee3"]);
-	highParams.set("bit", params["bit3"]);
-	highParams.set("bypass", params["bypass3"]);
-	highDist.update(highParams);
+	updateBands(params);
+	for (int band = 0; band < numBands; ++band) bandDistortions[band].update(params, band);
+	for (auto& distortion : distortions) distortion.update(params, bandDistortions);
+	updateCrossover(params);
+	updateResamplers(params);
+
+	for (int band = 0; band < MAX_BANDS; ++band) {
+		bandEnabled[band].setValue(1.0f - params[keys.band[band].bypass]);
+		if (band >= previousBands && band < numBands) {
+			bandEnabled[band].reset();
+			bandDistortions[band].reset();
+		}
+	}
+	for (int split = 0; split < MAX_BANDS - 1; ++split) {
+		crossoverCuts[split].update(params[keys.crossover[split]]);
+		if (split >= previousBands - 1 && split < numBands - 1) crossoverCuts[split].reset();
+	}
 
 	// Global 
-	lowEnabled.setValue(1.0f - params["bypass1"]);
-	midEnabled.setValue(1.0f - params["bypass2"]);
-	highEnabled.setValue(1.0f - params["bypass3"]);
-	allEnabled.setValue(1.0f - params["bypass"]);
-	inputGain.update(dbToLinear(params["inputGain"]));
-	outputGain.update(dbToLinear(params["outputGain"]));
-	bypass = static_cast<bool>(params["bypass"]);
-	mix.update(params["mix"] * 0.01f);
-	lowMidCut.update(params["lowMidCut"]);
-	midHighCut.update(params["midHighCut"]);
+	allEnabled.setValue(1.0f - params[keys.bypass]);
+	inputGain.update(dbToLinear(params[keys.inputGain]));
+	outputGain.update(dbToLinear(params[keys.outputGain]));
+	bypass = static_cast<bool>(params[keys.bypass]);
+	mix.update(params[keys.mix] * 0.01f);
+
+	updateTail();
+}
+
+void MultibandDistortion::rebuildTables() {
+	for (auto& band : bandDistortions) band.rebuildTable();
+	linearCrossover.rebuild();
+}
+
+int MultibandDistortion::getLatencySamples() const {
+	return latency.load(std::memory_order_relaxed);
+}
+
+int MultibandDistortion::getTailSamples() const {
+	return tail.load(std::memory_order_relaxed);
+}
+
+// A new band count changes the whole crossover tree, so it starts from
+// rest instead of from filter states left by another layout.
+void MultibandDistortion::updateBands(DSPParameters<float>& params) {
+	auto bands = getBandCount(params);
+	if (bands == numBands) return;
+
+	numBands = bands;
+	resetCrossover();
+}
+
+void MultibandDistortion::resetCrossover() {
+	for (auto& filter : splitFilters) filter.reset();
+	for (auto& filter : allpassFilters) filter.reset();
+}
+
+// Switching the crossover over starts the new one from rest. The
+// convolution gets every cutoff whether it is in use or not, and lets go
+// of its kernels while the tree runs.
+void MultibandDistortion::updateCrossover(DSPParameters<float>& params) {
+	auto& keys = getParameterKeys();
+	auto linear = params[keys.linearPhaseCrossover] > 0.5f;
+	if (linear != linearPhaseCrossover) {
+		linearPhaseCrossover = linear;
+		if (linearPhaseCrossover) {
+			linearCrossover.reset();
+		}
+		else {
+			linearCrossover.release();
+			resetCrossover();
+		}
+	}
+
+	std::array<float, MAX_BANDS - 1> cuts;
+	for (int split = 0; split < MAX_BANDS - 1; ++split) {
+		cuts[split] = params[keys.crossover[split]];
+	}
+	linearCrossover.request(cuts);
+}
+
+int MultibandDistortion::getOversamplingFactor(DSPParameters<float>& params, int band) {
+	auto& keys = getParameterKeys();
+	auto factor = static_cast<int>(params[keys.band[band].quality]);
+	if (params[keys.nonRealtime] > 0.5f) factor = std::max(factor, static_cast<int>(params[keys.renderQuality]));
+	return juce::jlimit(0, MAX_OVERSAMPLING_FACTOR, factor);
+}
+
+// Groups the bands by factor and sets the lane delays from the resampler
+// latencies, the shaper's delay included: the resamplers pad it out to
+// whole base-rate samples, at the base rate it is one sample already.
+// Resamplers are prepared again when their design or the shaper's delay
+// changes; shapeBands() resets the ones that come back into use.
+void MultibandDistortion::updateResamplers(DSPParameters<float>& params) {
+	auto& keys = getParameterKeys();
+	auto design = params[keys.linearPhase] > 0.5f ? ResamplerDesign::linearPhase : ResamplerDesign::minimumPhase;
+	auto delay = params[keys.antialias] > 0.5f ? 1 : 0;
+	if (design != resamplerDesign || delay != shaperDelay) {
+		resamplerDesign = design;
+		shaperDelay = delay;
+		for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) {
+			for (int r = 0; r < registerCount; ++r) getResampler(factor, r).prepare(factor, resamplerDesign, shaperDelay);
+		}
+	}
+
+	for (int band = 0; band < numBands; ++band) bandFactors[band] = getOversamplingFactor(params, band);
+	for (int r = 0; r < registerCount; ++r) {
+		for (auto& mask : factorMasks[r]) mask = LaneMask::expand(0);
+		for (int lane = 0; lane < BAND_GROUP_SIZE; ++lane) {
+			auto band = registerBands[r][lane];
+			if (band < numBands) factorMasks[r][bandFactors[band]].set(lane, ~0u);
+		}
+	}
+
+	std::array<int, MAX_OVERSAMPLING_FACTOR + 1> latencies{ shaperDelay };
+	for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) {
+		latencies[factor] = getResampler(factor, 0).getLatency();
+	}
+
+	auto total = 0;
+	for (int band = 0; band < numBands; ++band) {
+		total = std::max(total, latencies[bandFactors[band]]);
+	}
+	jassert(total < COMPENSATION_SIZE);
+	bandDelays.fill(0);
+	for (int band = 0; band < numBands; ++band) {
+		bandDelays[band] = total - latencies[bandFactors[band]];
+	}
+	resamplerLatency = total;
+	latency.store(total + (linearPhaseCrossover ? linearCrossover.getLatency() : 0), std::memory_order_relaxed);
+}
+
+// The crossover rings for longest, at its lowest cut; later cuts never
+// go below it. Each band's resampler adds its own tail on top of the lane
+// delay, and the shaper holds on to one sample, more with ADAA: its
+// half-sample allpass rings for longest at the base rate.
+void MultibandDistortion::updateTail() {
+	auto crossover = linearPhaseCrossover
+		? linearCrossover.getTailLength()
+		: static_cast<int>(std::ceil(CROSSOVER_TAIL_CYCLES * sampleRate / std::max(1.0f, crossoverCuts[0].read())));
+
+	auto bands = resamplerLatency;
+	for (int band = 0; band < numBands; ++band) {
+		auto factor = bandFactors[band];
+		if (factor == 0) continue;
+		bands = std::max(bands, bandDelays[band] + static_cast<int>(std::ceil(getResampler(factor, 0).getTailLength())));
+	}
+
+	auto shaper = 1;
+	if (shaperDelay > 0) shaper += static_cast<int>(std::ceil(FractionalDelay<float>(0.5).getTailLength()));
+
+	tailSamples = crossover + bands + shaper;
+	tail.store(tailSamples, std::memory_order_relaxed);
 }
 
 void MultibandDistortion::processBlock(float* const* inputBuffer, int numChannels, int numSamples) {
+	numChannels = std::min(numChannels, channelCount);
+
+	for (int start = 0; start < numSamples; start += CONTROL_BLOCK_SIZE) {
+		auto n = std::min(CONTROL_BLOCK_SIZE, numSamples - start);
+
+		// Silence past the tail comes out as silence without running
+		// anything, smoothers included.
+		auto silent = isSilent(inputBuffer, numChannels, start, n);
+		if (!silent) {
+			silentSamples = 0;
+		}
+		else if (silentSamples >= tailSamples) {
+			idle = true;
+			for (int ch = 0; ch < numChannels; ++ch) std::fill_n(inputBuffer[ch] + start, n, 0.0f);
+			continue;
+		}
+		if (idle) {
+			idle = false;
+			wake();
+		}
+		if (silent) silentSamples += n;
+
+		auto identical = numChannels == 2 && !packChannels && std::memcmp(inputBuffer[0] + start, inputBuffer[1] + start, n * sizeof(float)) == 0;
+		if (!identical) identicalSamples = 0;
+		auto mono = identical && identicalSamples >= tailSamples;
+		if (identical) identicalSamples = std::min(identicalSamples + n, tailSamples);
+		if (dualMono && !mono) copyChannel(0, 1);
+		dualMono = mono;
+		auto channels = dualMono ? 1 : numChannels;
+
+		// Smoothers advance once per control block and every channel reads
+		// the same ramps, so all channels see identical gain curves.
+		inputGainRamp = inputGain.ramp(n);
+		outputGainRamp = outputGain.ramp(n);
+		mixRamp = mix.ramp(n);
+		allEnabledRamp = allEnabled.ramp(n);
+		for (int split = 0; split < numBands - 1; ++split) {
+			crossoverRamps[split] = crossoverCuts[split].ramp(n);
+		}
+		// Lanes past the last band and bands whose bypass has faded out are
+		// weighted by zero in the sum and left out of the shaping.
+		std::array<ParameterRamp, MAX_BANDS> enabled{};
+		for (int band = 0; band < numBands; ++band) {
+			enabled[band] = bandEnabled[band].ramp(n);
+			bandActive[band] = !(enabled[band].isConstant() && bandEnabled[band].isSilent());
+			if (!bandActive[band]) enabled[band] = ParameterRamp{};
+		}
+		findUsedRegisters(channels, enabled);
+
+		// Once the global bypass has faded out only the dry path runs, and
+		// the bands start over from rest when it fades back in.
+		if (allEnabledRamp.isConstant() && allEnabled.isSilent()) {
+			bypassed = true;
+			bypassBlock(inputBuffer, channels, start, n);
+			if (dualMono) std::copy_n(inputBuffer[0] + start, n, inputBuffer[1] + start);
+			continue;
+		}
+		if (bypassed) {
+			bypassed = false;
+			resumeBands();
+		}
+
+		// A band's smoothers only move while it is in use.
+		for (int band = 0; band < numBands; ++band) {
+			if (bandActive[band]) bandDistortions[band].advance(n);
+		}
+		for (int i = 0; i < numUsedRegisters; ++i) {
+			auto r = usedRegisters[i];
+			if (activeFactors[r] != 0) distortions[r].advance(bandDistortions, activeMasks[r]);
+		}
+
+		splitBands(inputBuffer, channels, start, n);
+		(this->*shapeStage)(channels, n);
+		alignBands(n);
+		alignDry(channels, n);
+
+		for (int ch = 0; ch < channels; ++ch) {
+			auto* samples = inputBuffer[ch] + start;
+
+			sumBands(ch, samples, n);
+			mixOutput(ch, samples, n);
+		}
+		if (dualMono) std::copy_n(inputBuffer[0] + start, n, inputBuffer[1] + start);
+	}
+}
+
+// Lists the registers with a lane of a band and channel in use, and marks
+// the lanes whose band is active, the factors they run at and their fades.
+void MultibandDistortion::findUsedRegisters(int numChannels, const std::array<ParameterRamp, MAX_BANDS>& enabled) {
+	numUsedRegisters = 0;
+	for (int r = 0; r < registerCount; ++r) {
+		auto used = false;
+		activeMasks[r] = LaneMask::expand(0);
+		activeFactors[r] = 0;
+		for (int lane = 0; lane < BAND_GROUP_SIZE; ++lane) {
+			auto band = registerBands[r][lane];
+			enabledRamps[r].set(lane, band < numBands ? enabled[band] : ParameterRamp{});
+			if (band >= numBands || registerChannels[r][lane] >= numChannels) continue;
+			used = true;
+			if (!bandActive[band]) continue;
+			activeMasks[r].set(lane, ~0u);
+			activeFactors[r] |= 1 << bandFactors[band];
+		}
+		if (used) usedRegisters[numUsedRegisters++] = r;
+	}
+}
+
+// Apply the input gain and split the dry signal into the band frames.
+void MultibandDistortion::splitBands(float* const* inputBuffer, int numChannels, int start, int numSamples) {
+	for (int ch = 0; ch < numChannels; ++ch) {
+		for (int s = 0; s < numSamples; ++s) {
+			getDryFrames(ch)[s] = inputGainRamp[s] * inputBuffer[ch][start + s];
+		}
+	}
+	for (int i = 0; i < numUsedRegisters; ++i) {
+		std::fill_n(getRegisterFrames(usedRegisters[i]), numSamples * Lane::SIMDNumElements, 0.0f);
+	}
+
+	(this->*splitStage)(numChannels, numSamples);
+}
+
+template <InstructionSet Set>
+void MultibandDistortion::splitDry(int numChannels, int numSamples) {
+	CpuDispatch::run<Set>([&] {
+		if (linearPhaseCrossover) splitLinearPhase(numChannels, numSamples);
+		else splitTree(numChannels, numSamples);
+	});
+}
+
+// Run the crossover tree one split at a time over the block. The split
+// filters have the channels of a channel group side by side, the allpasses
+// the lanes of a band register. Lanes of bands not split off yet hold zero,
+// so the allpass states of those lanes stay at rest: at every sample a
+// split's allpasses run before its band is written. Cutoffs never fall
+// below the previous split, or the bands in between would overlap.
+void MultibandDistortion::splitTree(int numChannels, int numSamples) {
+	alignas(sizeof(Lane)) float band[Lane::SIMDNumElements];
+	std::array<std::array<Lane, CONTROL_BLOCK_SIZE>, MAX_CHANNELS / CHANNEL_GROUP_SIZE> rests;
+	std::array<LRFilter<Lane>, MAX_CHANNELS / CHANNEL_GROUP_SIZE> filters;
+	std::array<float*, MAX_CHANNELS> bands{};
+	std::array<LRFilter<Lane>*, MAX_BAND_REGISTERS> allpasses{};
+	std::array<float*, MAX_BAND_REGISTERS> allpassFrames{};
+	std::array<float, CONTROL_BLOCK_SIZE> cuts;
+	auto groups = (numChannels + CHANNEL_GROUP_SIZE - 1) / CHANNEL_GROUP_SIZE;
+
+	for (int group = 0; group < groups; ++group) {
+		auto first = group * CHANNEL_GROUP_SIZE;
+		auto channels = std::min(static_cast<int>(CHANNEL_GROUP_SIZE), numChannels - first);
+		alignas(sizeof(Lane)) float input[Lane::SIMDNumElements]{};
+		for (int s = 0; s < numSamples; ++s) {
+			for (int i = 0; i < channels; ++i) input[i] = getDryFrames(first + i)[s];
+			rests[group][s] = Lane::fromRawArray(input);
+		}
+	}
+	cuts.fill(0.0f);
+
+	for (int split = 0; split < numBands; ++split) {
+		auto last = split == numBands - 1;
+		auto ramp = crossoverRamps[split];
+
+		// Local copies keep the filter states out of memory in the loop.
+		for (int group = 0; group < groups; ++group) filters[group] = getSplitFilter(split, group);
+		for (int ch = 0; ch < numChannels; ++ch) bands[ch] = getBandFrames(split, ch);
+		auto numAllpasses = 0;
+		for (int i = 0; i < numUsedRegisters && !last; ++i) {
+			auto r = usedRegisters[i];
+			if (registerBands[r][0] >= split) continue;
+			allpasses[numAllpasses] = &getAllpass(split, r);
+			allpassFrames[numAllpasses++] = getRegisterFrames(r);
+		}
+
+		for (int s = 0; s < numSamples; ++s) {
+			if (!last) {
+				cuts[s] = std::max(cuts[s], ramp[s]);
+				for (int group = 0; group < groups; ++group) filters[group].setFrequency(cuts[s]);
+			}
+
+			// The cutoff is the same in every channel group, and so are
+			// the coefficients.
+			for (int i = 0; i < numAllpasses; ++i) {
+				auto* frame = allpassFrames[i] + s * Lane::SIMDNumElements;
+				allpasses[i]->processAllpass(Lane::fromRawArray(frame), filters[0]).copyToRawArray(frame);
+			}
+
+			for (int group = 0; group < groups; ++group) {
+				auto first = group * CHANNEL_GROUP_SIZE;
+				auto channels = std::min(static_cast<int>(CHANNEL_GROUP_SIZE), numChannels - first);
+				auto& rest = rests[group][s];
+				auto low = rest;
+				if (!last) filters[group].processSample(rest, low, rest);
+
+				low.copyToRawArray(band);
+				for (int i = 0; i < channels; ++i) {
+					bands[first + i][s * Lane::SIMDNumElements] = band[i];
+				}
+			}
+		}
+		for (int group = 0; group < groups; ++group) getSplitFilter(split, group) = filters[group];
+	}
+}
+
+// The convolution takes the dry signal, hands back every band and leaves
+// the dry signal delayed by its latency, in step with the bands.
+void MultibandDistortion::splitLinearPhase(int numChannels, int numSamples) {
+	std::array<float*, MAX_CHANNELS> dry{};
+	for (int ch = 0; ch < numChannels; ++ch) dry[ch] = getDryFrames(ch);
+
+	linearCrossover.process(dry.data(), numChannels, numSamples, numBands, [this](int ch, int band, int offset, const float* samples, int n) {
+		auto* frames = getBandFrames(band, ch);
+		for (int s = 0; s < n; ++s) {
+			frames[(offset + s) * Lane::SIMDNumElements] = samples[s];
+		}
+	});
+}
+
+// Bands at the base rate are shaped in place. The others go through the
+// resampler for their factor, all lanes of a register at the same factor
+// in one pass, so the cost follows the factors actually in use. Only the
+// shaper runs oversampled; the band gains are applied on either side at
+// the base rate.
+// Bypassed bands share the pass of their register and factor, which costs
+// the same with or without them, but a register or factor left with no
+// active band is skipped. A resampler that sat out the last block starts
+// again from silence, so no band picks up another band's old state.
+// From three channels on the registers hold the channels of a band, so a
+// pass is shared by four channels rather than by the bands of one, and
+// registers and factors are fully used whatever the band count and the
+// bands' factors.
+template <InstructionSet Set>
+void MultibandDistortion::shapeBands(int, int numSamples) {
+	CpuDispatch::run<Set>([&] {
+		for (int i = 0; i < numUsedRegisters; ++i) {
+			auto r = usedRegisters[i];
+			auto factors = activeFactors[r];
+			if (factors == 0) continue;
+
+			auto& distortion = distortions[r];
+			auto& masks = factorMasks[r];
+			auto active = activeMasks[r];
+			auto* frames = getRegisterFrames(r);
+
+			distortion.applyInputGain(frames, numSamples);
+
+			for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) {
+				if (!(factors & (1 << factor))) continue;
+
+				auto& resampler = getResampler(factor, r);
+				if (!(previousFactors[r] & (1 << factor))) resampler.reset();
+				auto* oversampled = oversampledFrames.data();
+
+				resampler.upsample(asLanes(frames), asLanes(oversampled), numSamples);
+				distortion.processBlock(oversampled, numSamples << factor, factor, masks[factor] & active);
+				resampler.downsample(asLanes(oversampled), asLanes(oversampled), numSamples);
+
+				for (int s = 0; s < numSamples; ++s) {
+					auto* frame = frames + s * Lane::SIMDNumElements;
+					auto shaped = Lane::fromRawArray(oversampled + s * Lane::SIMDNumElements);
+					laneSelect(masks[factor], shaped, Lane::fromRawArray(frame)).copyToRawArray(frame);
+				}
+			}
+
+			if (factors & 1) distortion.processBlock(frames, numSamples, 0, masks[0] & active);
+
+			distortion.applyOutputGain(frames, numSamples);
+		}
+	});
+	previousFactors = activeFactors;
+}
+
+// Delay every band lane by its band's delay through per-register histories.
+void MultibandDistortion::alignBands(int numSamples) {
+	if (resamplerLatency == 0) return;
+
+	for (int i = 0; i < numUsedRegisters; ++i) {
+		auto r = usedRegisters[i];
+		auto* history = compensationFrames.data() + r * COMPENSATION_SIZE * Lane::SIMDNumElements;
+		auto* frames = getRegisterFrames(r);
+		std::array<int, BAND_GROUP_SIZE> delays;
+		for (int lane = 0; lane < BAND_GROUP_SIZE; ++lane) delays[lane] = bandDelays[registerBands[r][lane]];
+
+		for (int s = 0; s < numSamples; ++s) {
+			auto position = (compensationPosition + s) & (COMPENSATION_SIZE - 1);
+			auto* frame = frames + s * Lane::SIMDNumElements;
+			for (size_t lane = 0; lane < Lane::SIMDNumElements; ++lane) {
+				history[position * Lane::SIMDNumElements + lane] = frame[lane];
+				auto delayed = (position - delays[lane]) & (COMPENSATION_SIZE - 1);
+				frame[lane] = history[delayed * Lane::SIMDNumElements + lane];
+			}
+		}
+	}
+}
+
+// Delay the dry signal by the whole resampler latency. This runs after
+// alignBands() and moves the position both share.
+void MultibandDistortion::alignDry(int numChannels, int numSamples) {
+	if (resamplerLatency == 0) return;
+
+	for (int ch = 0; ch < numChannels; ++ch) {
+		auto* history = dryHistory.data() + ch * COMPENSATION_SIZE;
+		auto* dry = getDryFrames(ch);
+		for (int s = 0; s < numSamples; ++s) {
+			auto position = (compensationPosition + s) & (COMPENSATION_SIZE - 1);
+			history[position] = dry[s];
+			dry[s] = history[(position - resamplerLatency) & (COMPENSATION_SIZE - 1)];
+		}
+	}
+	compensationPosition = (compensationPosition + numSamples) & (COMPENSATION_SIZE - 1);
+}
+
+// The dry path alone: input gain, the delay of the linear-phase crossover
+// and the resampler latency. This is what mixOutput() leaves once the
+// global bypass has faded out. The crossover keeps taking its input, so
+// it has no gap to fill when the bands come back.
+void MultibandDistortion::bypassBlock(float* const* inputBuffer, int numChannels, int start, int numSamples) {
+	std::array<float*, MAX_CHANNELS> dry{};
 	for (int ch = 0; ch < numChannels; ++ch) {
-		for (auto s = 0; s < numSamples; ++s) {
-			auto sample = inputGain.next() * inputBuffer[ch][s];
+		dry[ch] = getDryFrames(ch);
+		for (int s = 0; s < numSamples; ++s) {
+			dry[ch][s] = inputGainRamp[s] * inputBuffer[ch][start + s];
+		}
+	}
+
+	if (linearPhaseCrossover) {
+		linearCrossover.process(dry.data(), numChannels, numSamples, 0, [](int, int, int, const float*, int) {});
+	}
+	alignDry(numChannels, numSamples);
+
+	for (int ch = 0; ch < numChannels; ++ch) {
+		std::copy_n(dry[ch], numSamples, inputBuffer[ch] + start);
+	}
+}
+
+// Nothing the bands held when the bypass faded out is wanted anymore.
+// They start from rest, with the smoothed parameters where they were
+// heading.
+void MultibandDistortion::resumeBands() {
+	resetCrossover();
+	for (auto& band : bandDistortions) band.reset();
+	for (auto& distortion : distortions) distortion.reset();
+	previousFactors.fill(0);
+	std::fill(compensationFrames.begin(), compensationFrames.end(), 0.0f);
+}
+
+// After an idle stretch every state starts from rest, where it was
+// decaying to anyway, and the smoothers jump to their targets. With only
+// silence before, neither can be heard.
+void MultibandDistortion::wake() {
+	resumeBands();
+	linearCrossover.reset();
+	std::fill(dryHistory.begin(), dryHistory.end(), 0.0f);
 
-			float lowBandFiltered, midBandFiltered, highBandFiltered;
-			float lowBandDistorted, midBandDistorted, highBandDistorted;
+	inputGain.reset();
+	outputGain.reset();
+	mix.reset();
+	for (auto& cut : crossoverCuts) cut.reset();
+	for (auto& enabled : bandEnabled) enabled.reset();
+	allEnabled.reset();
+}
 
-			lowMidFilter.setFrequency(lowMidCut.next());
-			midHighFilter.setFrequency(midHighCut.next());
+// Hands every per-channel state over, so channel to carries on exactly
+// where channel from is. The split filters keep the channels in lanes; in
+// stereo, the only layout with dual mono, every channel has band registers
+// of its own.
+void MultibandDistortion::copyChannel(int from, int to) {
+	jassert(!packChannels);
 
-			lowMidFilter.processSample(ch, sample, lowBandFiltered, midBandFiltered);
-			midHighFilter.processSample(ch, midBandFiltered, midBandFiltered, highBandFiltered);
+	for (int split = 0; split < MAX_BANDS - 1; ++split) {
+		auto& source = getSplitFilter(split, from / CHANNEL_GROUP_SIZE);
+		auto& target = getSplitFilter(split, to / CHANNEL_GROUP_SIZE);
+		for (auto state : { &LRFilter<Lane>::s1, &LRFilter<Lane>::s2, &LRFilter<Lane>::s3, &LRFilter<Lane>::s4 }) {
+			(target.*state).set(to % CHANNEL_GROUP_SIZE, (source.*state).get(from % CHANNEL_GROUP_SIZE));
+		}
+	}
+	for (int group = 0; group < BAND_GROUPS; ++group) {
+		auto source = getSlot(group * BAND_GROUP_SIZE, from) / BAND_GROUP_SIZE;
+		auto target = getSlot(group * BAND_GROUP_SIZE, to) / BAND_GROUP_SIZE;
+		for (int split = 0; split < MAX_BANDS - 1; ++split) getAllpass(split, target) = getAllpass(split, source);
+		for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) getResampler(factor, target) = getResampler(factor, source);
+		distortions[target].copyState(distortions[source]);
+		previousFactors[target] = previousFactors[source];
+	}
+	linearCrossover.copyChannel(from, to);
 
-			lowBandDistorted = lowDist.processSample(lowBandFiltered) * lowEnabled.next();
-			midBandDistorted = midDist.processSample(midBandFiltered) * midEnabled.next();
-			highBandDistorted = highDist.processSample(highBandFiltered) * highEnabled.next();
+	std::copy_n(compensationFrames.data() + from * COMPENSATION_FRAMES, COMPENSATION_FRAMES, compensationFrames.data() + to * COMPENSATION_FRAMES);
+	std::copy_n(dryHistory.data() + from * COMPENSATION_SIZE, COMPENSATION_SIZE, dryHistory.data() + to * COMPENSATION_SIZE);
+}
 
-			auto wet = mix.next() * (lowBandDistorted + midBandDistorted + highBandDistorted);
-			auto dry = (1.0f - mix.read()) * sample;
-			auto amplitude = allEnabled.next();
+bool MultibandDistortion::isSilent(float* const* inputBuffer, int numChannels, int start, int numSamples) const {
+	auto peak = 0.0f;
+	for (int ch = 0; ch < numChannels; ++ch) {
+		for (int s = 0; s < numSamples; ++s) {
+			peak = std::max(peak, std::abs(inputBuffer[ch][start + s]));
+		}
+	}
+	return peak <= static_cast<float>(TAIL_LEVEL);
+}
+
+// Sum the shaped bands of the channel into the output buffer, weighted by
+// their bypass fades, and blend with the dry signal by the mix. The
+// registers holding the channel's bands are added up one at a time over
+// the block, leaving out those with no active band and the lanes of other
+// channels.
+void MultibandDistortion::sumBands(int ch, float* samples, int numSamples) {
+	std::array<Lane, CONTROL_BLOCK_SIZE> wet;
+	wet.fill(Lane::expand(0.0f));
+	auto previous = -1;
+	for (int band = 0; band < numBands; ++band) {
+		auto r = getSlot(band, ch) / BAND_GROUP_SIZE;
+		if (r == previous) continue;
+		previous = r;
+		if (activeFactors[r] == 0) continue;
 
-			auto output = sample * (1.0f - amplitude) + ((wet + dry) * amplitude * outputGain.next());
-			inputBuffer[ch][s] = output;
+		auto lanes = LaneMask::expand(0);
+		for (int lane = 0; lane < BAND_GROUP_SIZE; ++lane) {
+			if (registerChannels[r][lane] == ch) lanes.set(lane, ~0u);
+		}
+		auto* frames = getRegisterFrames(r);
+		auto ramp = enabledRamps[r];
+		for (int s = 0; s < numSamples; ++s) {
+			wet[s] += (Lane::fromRawArray(frames + s * Lane::SIMDNumElements) * ramp[s]) & lanes;
 		}
 	}
+
+	auto* dry = getDryFrames(ch);
+	for (int s = 0; s < numSamples; ++s) {
+		samples[s] = wet[s].sum() * mixRamp[s] + dry[s] * (1.0f - mixRamp[s]);
+	}
 }
 
+// Output gain and the global bypass crossfade.
+void MultibandDistortion::mixOutput(int ch, float* samples, int numSamples) {
+	auto* dry = getDryFrames(ch);
 
+	for (int s = 0; s < numSamples; ++s) {
+		auto amplitude = allEnabledRamp[s];
+		samples[s] = dry[s] * (1.0f - amplitude) + samples[s] * amplitude * outputGainRamp[s];
+	}
+}
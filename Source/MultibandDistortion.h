@@ -4,32 +4,270 @@
 #include "DSPParameters.h"
 #include "Filters.h"
 #include "FilteredParameter.h"
+#include "LaneUtils.h"
+#include "ShaperCurves.h"
+#include "WaveshaperTable.h"
+#include "Resampler.h"
+#include "LinearPhaseCrossover.h"
+#include "AlignedArena.h"
+#include "CpuDispatch.h"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <utility>
 
 #define DEFAULT_SR 44100.0f
+// Up to 9.1.6.
+#define MAX_CHANNELS 16
+// Below this input step, relative to the input level, antiderivative
+// differences lose too much to float rounding and the curve is evaluated
+// at the midpoint instead.
+#define ADAA_TOLERANCE 1.0e-3f
+// Base-rate history for aligning the bands, enough for the longest
+// resampler latency. Power of two.
+#define COMPENSATION_SIZE 64
+#define MIN_BANDS 2
+#define MAX_BANDS 8
+// Periods of the lowest cutoff the IIR crossover tree takes to decay to
+// TAIL_LEVEL. Eight bands with every cut at the same frequency take 8.4.
+#define CROSSOVER_TAIL_CYCLES 9.0f
+
+// Band shapers run side by side in SIMD registers, one band of one channel
+// per lane. In mono and stereo a register holds four bands of a channel:
+// register g of channel ch has band g * BAND_GROUP_SIZE + i in lane i, so a
+// dual-mono second channel has registers of its own to leave out. From
+// three channels on the lanes run through the channels of the first band,
+// then those of the next band and so on: the registers fill up whatever the
+// band count, and with a multiple of four channels each one holds a single
+// band at a single oversampling factor. Registers without a band in use are
+// skipped, so the cost grows with the bands and channels in use.
+enum BandGroups {
+	BAND_GROUP_SIZE = static_cast<int>(Lane::SIMDNumElements),
+	BAND_GROUPS = (MAX_BANDS + BAND_GROUP_SIZE - 1) / BAND_GROUP_SIZE,
+	MAX_BAND_REGISTERS = MAX_CHANNELS * BAND_GROUPS
+};
+
+// The crossover tree's split filters run the channels side by side the
+// same way: channel group g holds channel g * CHANNEL_GROUP_SIZE + i in
+// lane i.
+enum ChannelGroups {
+	CHANNEL_GROUP_SIZE = static_cast<int>(Lane::SIMDNumElements)
+};
+
+// Parameter ID of the crossover between band split and band split + 1.
+// The first two keep their three-band names, so older presets still load.
+inline std::string getCrossoverID(int split) {
+	if (split == 0) return "lowMidCut";
+	if (split == 1) return "midHighCut";
+	return "cut" + std::to_string(split + 1);
+}
 
-class Distortion
+// Every key the DSP reads from DSPParameters, built once. update() runs
+// on the audio thread, where putting a key together can allocate.
+struct ParameterKeys
 {
-	float sampleRate{ DEFAULT_SR };
-	int blockSize{ 0 };
-	float nChannels{ 2.0f };
+	struct Band
+	{
+		std::string inputGain, outputGain, drive, knee, bit, bypass, curve, quality;
+	};
 
+	std::string sampleRate{ "sampleRate" }, blockSize{ "blockSize" }, nChannels{ "nChannels" };
+	std::string bands{ "bands" }, mix{ "mix" }, inputGain{ "inputGain" }, outputGain{ "outputGain" }, bypass{ "bypass" };
+	std::string tableShaper{ "tableShaper" }, antialias{ "antialias" };
+	std::string nonRealtime{ "nonRealtime" }, renderQuality{ "renderQuality" };
+	std::string linearPhase{ "linearPhase" }, linearPhaseCrossover{ "linearPhaseCrossover" };
+	std::array<Band, MAX_BANDS> band;
+	std::array<std::string, MAX_BANDS - 1> crossover;
+
+	ParameterKeys() {
+		for (int b = 0; b < MAX_BANDS; ++b) {
+			auto suffix = std::to_string(b + 1);
+			band[b] = { "inputGain" + suffix, "outputGain" + suffix, "drive" + suffix, "knee" + suffix,
+				"bit" + suffix, "bypass" + suffix, "curve" + suffix, "quality" + suffix };
+		}
+		for (int split = 0; split < MAX_BANDS - 1; ++split) crossover[split] = getCrossoverID(split);
+	}
+};
+
+// First built by prepare(), off the audio thread.
+inline const ParameterKeys& getParameterKeys() {
+	static const ParameterKeys keys;
+	return keys;
+}
+
+inline int getBandCount(DSPParameters<float>& params) {
+	return juce::jlimit(MIN_BANDS, MAX_BANDS, static_cast<int>(params[getParameterKeys().bands]));
+}
+
+// Stages a control block can skip when every band agrees: with knee 1 both
+// pow() calls in the clipper are the identity and at 32 bits the bitcrusher
+// only rounds below float precision.
+// ANTIALIAS selects the first-order antiderivative (ADAA) versions of the
+// shaper and the bitcrusher.
+// Each combination gets its own compiled kernel, once per shaper curve plus
+// once for blocks where the bands use different curves, and each of those
+// once per instruction set.
+enum KernelFlags { KNEE_ONE = 1, NO_CRUSH = 2, ANTIALIAS = 4, KERNEL_COUNT = 8 };
+enum { MIXED_CURVES = CURVE_COUNT };
+
+// Settings and smoothers of one band. Every register with a lane of the
+// band reads them, so all of the band's channels get the same ramps.
+class BandDistortion
+{
 	FilteredParameter inputGain{};
 	FilteredParameter outputGain{};
 	FilteredParameter drive{};
-	FilteredParameter mix{};
 	FilteredParameter knee{};
-	int bit{};
 
-	float bitcrush(float sample, int bit);
-	float clip(float input, float drive, float knee);
-	float limit(float sample);
+	// Optional table-driven clipper, also built for ADAA, which needs the
+	// antiderivative of the variable curve for knees other than 1.
+	bool useTables{ false };
+	WaveshaperTableCache tableCache;
 
 public:
 
-	void prepare(DSPParameters<float>& params);
-	void update(DSPParameters<float>& params);
-	void processBlock(float* const* inputBuffer, int numChannels, int numSamples);
-	float processSample(float sample);
+	int bit{ 32 };
+	int curve{ 0 };
+
+	// Ramps of the current control block at the base rate, and the band's
+	// table when it matches the settled knee.
+	ParameterRamp inputGainRamp, outputGainRamp, driveRamp, kneeRamp;
+	const WaveshaperTable* table{ nullptr };
+
+	void prepare(float sampleRate);
+	void update(DSPParameters<float>& params, int band);
+	void reset();
+	void advance(int numSamples);
+	// Builds the table the audio thread asked for. Call from a background
+	// or message thread, never from the audio thread.
+	void rebuildTable();
+
+};
+
+// Shaper for one register. Lane i shapes band bands[i]; lanes whose band
+// is not in use are left out of bandMask.
+class LaneDistortion
+{
+	std::array<int, BAND_GROUP_SIZE> bands{};
+
+	// Ramps of the current control block at the base rate, and the same
+	// ramps stretched over the frames of the rate being processed.
+	// The band gains are linear and always run at the base rate, around
+	// the resampling; unityGain skips them for the block.
+	struct BandRamps
+	{
+		LaneRamp drive, knee;
+	};
+	BandRamps controlRamps, ramps;
+	LaneRamp inputGainRamp, outputGainRamp;
+	bool unityGain{ true };
+	// Bitcrusher step and its reciprocal, recomputed only in update().
+	// Lanes at full resolution are left out of crushMask and pass unchanged.
+	Lane quantizationStep = Lane::expand(1.0f);
+	Lane inverseQuantizationStep = Lane::expand(1.0f);
+	LaneMask crushMask = LaneMask::expand(0);
+	LaneMask bandMask = LaneMask::expand(0);
+	int numLanes{ 0 };
+
+	// A lane uses its band's table for the current block only when the
+	// table matches the settled knee; lanes without a table fall back to
+	// the analytic curve.
+	std::array<const WaveshaperTable*, BAND_GROUP_SIZE> activeTables{};
+	LaneMask tableMask = LaneMask::expand(0);
+	int numTableLanes{ 0 };
+	int numActiveLanes{ 0 };
+
+	// Lanes shaped by each curve, and a bit per curve any lane uses.
+	std::array<LaneMask, CURVE_COUNT> curveMasks{};
+	int curvesInUse{ 0 };
+
+	// ADAA replaces f(x) by (F(x) - F(x_prev)) / (x - x_prev), so each
+	// lane keeps its previous shaper and bitcrusher inputs. The integral
+	// is recomputed from the input at the start of every block, which
+	// keeps it valid when the curve or knee changed in between.
+	// Every oversampling factor has its own states, as bands at different
+	// rates go through the kernel in separate passes.
+	// integralMask has the lanes whose F is known for this block: variable
+	// curve bands need knee 1 or a matching table.
+	// The shaper's ADAA delays by half a sample, the bitcrusher's by
+	// another half. Lanes that are not crushed make up the second half in
+	// an allpass, so every lane comes out exactly one sample late at the
+	// rate it runs at, whatever its bit depth.
+	struct AntialiasState
+	{
+		Lane input = Lane::expand(0.0f);
+		Lane integral = Lane::expand(0.0f);
+		Lane crushInput = Lane::expand(0.0f);
+		FractionalDelay<Lane> halfSample{ 0.5 };
+	};
+	bool antialias{ false };
+	std::array<AntialiasState, MAX_OVERSAMPLING_FACTOR + 1> antialiasStates{};
+	AntialiasState* antialiasState{ nullptr };
+	LaneMask integralMask = LaneMask::expand(0);
+
+	// Picked in advance() from the block's ramps and curves, run by
+	// processBlock(). Indexed by flags + KERNEL_COUNT * curve, in the table
+	// of the instruction set prepare() was given.
+	using Kernel = void (LaneDistortion::*)(float*, int);
+	using KernelTable = std::array<Kernel, KERNEL_COUNT * (MIXED_CURVES + 1)>;
+	static const std::array<KernelTable, INSTRUCTION_SET_COUNT> kernels;
+	const KernelTable* kernelTable{ &kernels[0] };
+	int kernelIndex{ 0 };
+
+	template <InstructionSet Set, size_t... Index>
+	static KernelTable makeKernels(std::index_sequence<Index...>);
+
+	// Band lanes processBlock() writes back, the others pass unchanged.
+	LaneMask writeMask = LaneMask::expand(0);
+
+	template <InstructionSet Set, int Flags, int Curve>
+	void processKernel(float* frames, int numFrames);
+	template <int Flags, int Curve>
+	Lane processFrame(Lane frame, int index);
+	template <int Flags, int Curve>
+	Lane shape(Lane driven, int index);
+	template <int Flags, int Curve = 0>
+	Lane shapeMixed(Lane driven, int index);
+	template <int Flags>
+	Lane shapeVariable(Lane driven, int index);
+	template <int Flags, int Curve>
+	Lane shapeAntialiased(Lane driven, int index);
+
+	template <int Flags, int Curve>
+	Lane integral(Lane driven);
+	template <int Flags, int Curve = 0>
+	Lane integralMixed(Lane driven);
+	template <int Flags>
+	Lane integralVariable(Lane driven);
+
+	Lane bitcrush(Lane sample);
+	Lane bitcrushAntialiased(Lane sample);
+	Lane clip(Lane driven, Lane curveKnee);
+	Lane clipUnitKnee(Lane driven);
+	Lane clipTable(Lane driven);
+	Lane limit(Lane sample);
+
+public:
+
+	using BandSettings = std::array<BandDistortion, MAX_BANDS>;
+
+	// The bands of the lanes, in ascending order.
+	void prepare(const std::array<int, BAND_GROUP_SIZE>& laneBands, InstructionSet instructionSet);
+	void update(DSPParameters<float>& params, const BandSettings& settings);
+	void reset();
+	// Takes over the ADAA states of other, for a register that carries on
+	// exactly where other is.
+	void copyState(const LaneDistortion& other);
+	// Gathers the ramps of the lanes in active from the bands, which have
+	// advanced for this block already.
+	void advance(const BandSettings& settings, LaneMask active);
+	// Base-rate band gains, before and after processBlock().
+	void applyInputGain(float* frames, int numFrames);
+	void applyOutputGain(float* frames, int numFrames);
+	// Frames at 2^factor times the base rate, spanning one control block.
+	// Only band lanes in lanes are written.
+	void processBlock(float* frames, int numFrames, int factor, LaneMask lanes);
 
 };
 
@@ -38,33 +276,222 @@ class MultibandDistortion {
 	int blockSize{ 0 };
 	float nChannels{ 1.0f };
 
-	Distortion lowDist;
-	Distortion midDist;
-	Distortion highDist;
+	// Per-channel states and the scratch of a control block live in one
+	// arena, laid out by allocate() for channelCount channels when
+	// preparing. Nothing is allocated after that.
+	AlignedArena arena;
+	int channelCount{ 0 };
+
+	// Bands in use, their settings and a shaper per band register, see
+	// BandGroups. Register r holds band registerBands[r][i] of channel
+	// registerChannels[r][i] in lane i; the layout is fixed by prepare().
+	int numBands{ 0 };
+	std::array<BandDistortion, MAX_BANDS> bandDistortions;
+	ArenaArray<LaneDistortion> distortions;
+	int registerCount{ 0 };
+	bool packChannels{ false };
+	std::array<std::array<int, BAND_GROUP_SIZE>, MAX_BAND_REGISTERS> registerBands{};
+	std::array<std::array<int, BAND_GROUP_SIZE>, MAX_BAND_REGISTERS> registerChannels{};
+
+	// Registers with a lane of a band and channel in use this control
+	// block, in ascending order. Every stage after the crossover's split
+	// filters runs over these.
+	std::array<int, MAX_BAND_REGISTERS> usedRegisters{};
+	int numUsedRegisters{ 0 };
+
+	int getSlot(int band, int ch) const {
+		return packChannels ? band * channelCount + ch : ch * MAX_BANDS + band;
+	}
 
-	DSPParameters<float> lowParams;
-	DSPParameters<float> midParams;
-	DSPParameters<float> highParams;
-	
 	FilteredParameter inputGain{};
 	FilteredParameter outputGain{};
 	FilteredParameter mix{1.0f};
 	bool bypass{ false };
 
-	LRFilter<float> lowMidFilter;
-	LRFilter<float> midHighFilter;
-	FilteredParameter lowMidCut{};
-	FilteredParameter midHighCut{};
+	// Crossover tree. Split s divides what is left above split s - 1 into
+	// band s and the rest, with the channels side by side in one register
+	// per channel group. Every band split off before then goes through the
+	// allpass of split s, so all bands leave with the same phase and sum
+	// back to a flat response. The allpasses run on the band registers, so
+	// a split costs one allpass per register rather than one per band and
+	// channel. The cutoff is the same in every channel group, and so are
+	// the coefficients they take from the split filters.
+	ArenaArray<LRFilter<Lane>> splitFilters;
+	ArenaArray<LRFilter<Lane>> allpassFilters;
+	std::array<FilteredParameter, MAX_BANDS - 1> crossoverCuts{};
+	int channelGroups{ 0 };
+
+	LRFilter<Lane>& getSplitFilter(int split, int channelGroup) {
+		return splitFilters[split * channelGroups + channelGroup];
+	}
+
+	LRFilter<Lane>& getAllpass(int split, int r) {
+		return allpassFilters[split * registerCount + r];
+	}
+
+	// With "linearPhaseCrossover" the bands come from an FFT convolution
+	// instead, at the cost of its latency. Its kernels are kept up to date
+	// in either mode: while the tree runs, the convolution is released, so
+	// rebuilds never wait on an audio thread that is not using it, and
+	// switching over finds kernels for the current cutoffs.
+	LinearPhaseCrossover<MAX_BANDS - 1> linearCrossover;
+	bool linearPhaseCrossover{ false };
 
-	SmoothLogParameter lowEnabled;
-	SmoothLogParameter midEnabled;
-	SmoothLogParameter highEnabled;
+	std::array<SmoothLogParameter, MAX_BANDS> bandEnabled;
 	SmoothLogParameter allEnabled;
 
+	// Scratch for one control block: per band register, one frame per
+	// sample, and per channel its dry signal. A channel takes BAND_GROUPS
+	// registers' worth in either layout. Each pipeline stage runs over it as a whole: crossover, band
+	// shaping, band sum, mix.
+	enum ScratchSizes {
+		BAND_FRAMES = BAND_GROUPS * CONTROL_BLOCK_SIZE * BAND_GROUP_SIZE,
+		OVERSAMPLED_FRAMES = (CONTROL_BLOCK_SIZE << MAX_OVERSAMPLING_FACTOR) * BAND_GROUP_SIZE,
+		COMPENSATION_FRAMES = BAND_GROUPS * COMPENSATION_SIZE * BAND_GROUP_SIZE
+	};
+	ArenaArray<float> bandFrames;
+	ArenaArray<float> dryFrames;
+
+	float* getRegisterFrames(int r) {
+		return bandFrames.data() + r * CONTROL_BLOCK_SIZE * Lane::SIMDNumElements;
+	}
+
+	// The lane of band on channel ch: sample s is at s * Lane::SIMDNumElements.
+	float* getBandFrames(int band, int ch) {
+		auto slot = getSlot(band, ch);
+		return getRegisterFrames(slot / BAND_GROUP_SIZE) + slot % BAND_GROUP_SIZE;
+	}
+
+	float* getDryFrames(int ch) {
+		return dryFrames.data() + ch * CONTROL_BLOCK_SIZE;
+	}
+
+	// Every band runs at its own oversampling factor, from "qualityN" or,
+	// when rendering offline, at least "renderQuality". The crossover
+	// splits at the base rate and each band is resampled on its own.
+	// Lanes of a register at the same factor share a resampler: it works
+	// on whole frames, so they are resampled side by side, whichever bands
+	// and channels they hold.
+	// All resamplers exist up front; a factor only runs while some band
+	// uses it and starts from silence when one switches to it.
+	ArenaArray<Resampler<Lane>> resamplers;
+
+	Resampler<Lane>& getResampler(int factor, int r) {
+		return resamplers[(factor - 1) * registerCount + r];
+	}
+	ResamplerDesign resamplerDesign{ ResamplerDesign::minimumPhase };
+	// Samples the shaper delays by at the rate it runs at: one with ADAA.
+	int shaperDelay{ 0 };
+	std::array<int, MAX_BANDS> bandFactors{};
+	std::array<std::array<LaneMask, MAX_OVERSAMPLING_FACTOR + 1>, MAX_BAND_REGISTERS> factorMasks{};
+
+	// Lanes of the current control block whose band has not faded out, and
+	// a bit per factor they use, then the same bits for the block before.
+	std::array<bool, MAX_BANDS> bandActive{};
+	std::array<LaneMask, MAX_BAND_REGISTERS> activeMasks{};
+	std::array<int, MAX_BAND_REGISTERS> activeFactors{};
+	std::array<int, MAX_BAND_REGISTERS> previousFactors{};
+	// Set while the global bypass has faded out and only the dry path runs.
+	bool bypassed{ false };
+
+	// Input counts as silent below TAIL_LEVEL. Once it has been silent for
+	// longer than the tail, every state has died away and nothing runs
+	// until it comes back.
+	int silentSamples{ 0 };
+	int tailSamples{ 0 };
+	std::atomic<int> tail{ 0 };
+	bool idle{ false };
+
+	// Stereo input with bit-identical channels. Identical input only gives
+	// identical output once the channels' states have caught up with each
+	// other, which takes the tail. From then on only the first channel
+	// runs and the second gets a copy, until the input tells them apart
+	// again and the second channel takes over the first one's state.
+	int identicalSamples{ 0 };
+	bool dualMono{ false };
+
+	// Frames of one control block at the highest factor. Each register
+	// goes up, through the shaper and back down before the next one
+	// starts, so they all take turns in the same frames.
+	ArenaArray<float> oversampledFrames;
+
+	// The bands leave their resamplers with different latencies. Each
+	// band is delayed up to the slowest one, the dry signal by all of it.
+	ArenaArray<float> compensationFrames;
+	ArenaArray<float> dryHistory;
+	std::array<int, MAX_BANDS> bandDelays{};
+	int compensationPosition{ 0 };
+	int resamplerLatency{ 0 };
+	// Resampler and crossover latency together.
+	std::atomic<int> latency{ 0 };
+
+	// The crossover and the band shaping, resamplers included, are built
+	// once per instruction set like the shaper kernels. prepare() picks the
+	// variants for CpuDispatch::getInstructionSet().
+	using Stage = void (MultibandDistortion::*)(int, int);
+	InstructionSet instructionSet{ InstructionSet::sse2 };
+	Stage splitStage{ nullptr };
+	Stage shapeStage{ nullptr };
+
+	// The scratch a control block runs through, besides the filter states.
+	// Host blocks of any length are cut into control blocks, so this is
+	// the working set whatever the host sends. In stereo it leaves half of
+	// a 32 KB L1 data cache for the states of the stages in use; every
+	// further channel adds its share.
+	static_assert((2 * (BAND_FRAMES + CONTROL_BLOCK_SIZE + COMPENSATION_FRAMES + COMPENSATION_SIZE) + OVERSAMPLED_FRAMES) * sizeof(float) <= 16 * 1024,
+		"control block scratch no longer fits the L1 budget");
+
+	void allocate(AlignedArena& layout);
+	int getOversamplingFactor(DSPParameters<float>& params, int band);
+	void updateBands(DSPParameters<float>& params);
+	void updateCrossover(DSPParameters<float>& params);
+	void resetCrossover();
+	void resumeBands();
+	void updateResamplers(DSPParameters<float>& params);
+	void updateTail();
+	void wake();
+	void copyChannel(int from, int to);
+	void findUsedRegisters(int numChannels, const std::array<ParameterRamp, MAX_BANDS>& enabled);
+
+	bool isSilent(float* const* inputBuffer, int numChannels, int start, int numSamples) const;
+
+	void splitBands(float* const* inputBuffer, int numChannels, int start, int numSamples);
+	template <InstructionSet Set>
+	void splitDry(int numChannels, int numSamples);
+	void splitTree(int numChannels, int numSamples);
+	void splitLinearPhase(int numChannels, int numSamples);
+	template <InstructionSet Set>
+	void shapeBands(int numChannels, int numSamples);
+	void alignBands(int numSamples);
+	void alignDry(int numChannels, int numSamples);
+	void bypassBlock(float* const* inputBuffer, int numChannels, int start, int numSamples);
+	void sumBands(int ch, float* samples, int numSamples);
+	void mixOutput(int ch, float* samples, int numSamples);
+
+	ParameterRamp inputGainRamp, outputGainRamp, mixRamp, allEnabledRamp;
+	std::array<ParameterRamp, MAX_BANDS - 1> crossoverRamps;
+	std::array<LaneRamp, MAX_BAND_REGISTERS> enabledRamps;
+
 public:
 
 	void prepare(DSPParameters<float>& params);
 	void update(DSPParameters<float>& params);
+	// Takes any number of samples, however many blockSize announced: they
+	// are worked through one control block at a time.
 	void processBlock(float* const* inputBuffer, int numChannels, int numSamples);
+	// Builds any waveshaper tables and crossover kernels the audio thread
+	// asked for. Call from a background or message thread.
+	void rebuildTables();
+
+	// Latency of the crossover and the band resampling in base-rate
+	// samples, as set by the last update(). Safe to read from any thread.
+	int getLatencySamples() const;
+
+	// Base-rate samples from the last input until the output has died
+	// away, latency included. Safe to read from any thread.
+	int getTailSamples() const;
+
+	// The kernel variants the last prepare() picked.
+	InstructionSet getInstructionSet() const { return instructionSet; }
 
 };
\ No newline at end of file
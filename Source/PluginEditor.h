@@ -31,23 +31,23 @@ private:
     int knobH = knobW * 1.275;
 
     // GUI Components
-    Knob lowInputGain   { apvtsParameters[INPUT_GAIN_1].get(),  knobW, knobH, audioProcessor.apvts, Band::LOW};
-    Knob lowOutputGain { apvtsParameters[OUTPUT_GAIN_1].get(),  knobW, knobH, audioProcessor.apvts, Band::LOW};
-    Knob lowDrive       { apvtsParameters[DRIVE_1].get(),       knobW, knobH, audioProcessor.apvts, Band::LOW};
-    Knob lowKnee        { apvtsParameters[KNEE_1].get(),        knobW, knobH, audioProcessor.apvts, Band::LOW};
-    Knob lowBit         { apvtsParameters[BIT_1].get(),         knobW, knobH, audioProcessor.apvts, Band::LOW};
+    Knob lowInputGain   { apvtsParameters[bandParameter(0, BAND_INPUT_GAIN)].get(),  knobW, knobH, audioProcessor.apvts, Band::LOW};
+    Knob lowOutputGain { apvtsParameters[bandParameter(0, BAND_OUTPUT_GAIN)].get(),  knobW, knobH, audioProcessor.apvts, Band::LOW};
+    Knob lowDrive       { apvtsParameters[bandParameter(0, BAND_DRIVE)].get(),       knobW, knobH, audioProcessor.apvts, Band::LOW};
+    Knob lowKnee        { apvtsParameters[bandParameter(0, BAND_KNEE)].get(),        knobW, knobH, audioProcessor.apvts, Band::LOW};
+    Knob lowBit         { apvtsParameters[bandParameter(0, BAND_BIT)].get(),         knobW, knobH, audioProcessor.apvts, Band::LOW};
     
-    Knob midInputGain   { apvtsParameters[INPUT_GAIN_2].get(),  knobW, knobH, audioProcessor.apvts, Band::MID};
-    Knob midOutputGain { apvtsParameters[OUTPUT_GAIN_2].get(),  knobW, knobH, audioProcessor.apvts, Band::MID};
-    Knob midDrive       { apvtsParameters[DRIVE_2].get(),       knobW, knobH, audioProcessor.apvts, Band::MID};
-    Knob midKnee        { apvtsParameters[KNEE_2].get(),        knobW, knobH, audioProcessor.apvts, Band::MID};
-    Knob midBit         { apvtsParameters[BIT_2].get(),         knobW, knobH, audioProcessor.apvts, Band::MID};    
+    Knob midInputGain   { apvtsParameters[bandParameter(1, BAND_INPUT_GAIN)].get(),  knobW, knobH, audioProcessor.apvts, Band::MID};
+    Knob midOutputGain { apvtsParameters[bandParameter(1, BAND_OUTPUT_GAIN)].get(),  knobW, knobH, audioProcessor.apvts, Band::MID};
+    Knob midDrive       { apvtsParameters[bandParameter(1, BAND_DRIVE)].get(),       knobW, knobH, audioProcessor.apvts, Band::MID};
+    Knob midKnee        { apvtsParameters[bandParameter(1, BAND_KNEE)].get(),        knobW, knobH, audioProcessor.apvts, Band::MID};
+    Knob midBit         { apvtsParameters[bandParameter(1, BAND_BIT)].get(),         knobW, knobH, audioProcessor.apvts, Band::MID};    
     
-    Knob highInputGain   { apvtsParameters[INPUT_GAIN_3].get(), knobW, knobH, audioProcessor.apvts, Band::HIGH};
-    Knob highOutputGain  { apvtsParameters[OUTPUT_GAIN_3].get(),knobW, knobH, audioProcessor.apvts, Band::HIGH};
-    Knob highDrive       { apvtsParameters[DRIVE_3].get(),      knobW, knobH, audioProcessor.apvts, Band::HIGH};
-    Knob highKnee        { apvtsParameters[KNEE_3].get(),       knobW, knobH, audioProcessor.apvts, Band::HIGH};
-    Knob highBit         { apvtsParameters[BIT_3].get(),        knobW, knobH, audioProcessor.apvts, Band::HIGH};    
+    Knob highInputGain   { apvtsParameters[bandParameter(2, BAND_INPUT_GAIN)].get(), knobW, knobH, audioProcessor.apvts, Band::HIGH};
+    Knob highOutputGain  { apvtsParameters[bandParameter(2, BAND_OUTPUT_GAIN)].get(),knobW, knobH, audioProcessor.apvts, Band::HIGH};
+    Knob highDrive       { apvtsParameters[bandParameter(2, BAND_DRIVE)].get(),      knobW, knobH, audioProcessor.apvts, Band::HIGH};
+    Knob highKnee        { apvtsParameters[bandParameter(2, BAND_KNEE)].get(),       knobW, knobH, audioProcessor.apvts, Band::HIGH};
+    Knob highBit         { apvtsParameters[bandParameter(2, BAND_BIT)].get(),        knobW, knobH, audioProcessor.apvts, Band::HIGH};    
     
     Knob globalInputGain   { apvtsParameters[INPUT_GLOBAL].get(),   knobW, knobH, audioProcessor.apvts, Band::GLOBAL};
     Knob globalOutputGain  { apvtsParameters[OUTPUT_GLOBAL].get(),  knobW, knobH, audioProcessor.apvts, Band::GLOBAL};
@@ -62,9 +62,9 @@ private:
 
     GroupComponentLookAndFeel groupComponentLookAndFeel{ static_cast<float>(screenWidth), static_cast<float>(screenHeight) };
 
-    Switch lowBypass    { apvtsParameters[BYPASS_1].get(), audioProcessor.apvts, Band::LOW, lowBandGroup};
-    Switch midBypass    { apvtsParameters[BYPASS_2].get(), audioProcessor.apvts, Band::MID, midBandGroup};
-    Switch highBypass   { apvtsParameters[BYPASS_3].get(), audioProcessor.apvts, Band::HIGH, highBandGroup};
+    Switch lowBypass    { apvtsParameters[bandParameter(0, BAND_BYPASS)].get(), audioProcessor.apvts, Band::LOW, lowBandGroup};
+    Switch midBypass    { apvtsParameters[bandParameter(1, BAND_BYPASS)].get(), audioProcessor.apvts, Band::MID, midBandGroup};
+    Switch highBypass   { apvtsParameters[bandParameter(2, BAND_BYPASS)].get(), audioProcessor.apvts, Band::HIGH, highBandGroup};
     Switch globalBypass { apvtsParameters[BYPASS].get(),   audioProcessor.apvts, Band::GLOBAL, globalGroup};
 
     std::unique_ptr<Drawable> logo = Drawable::createFromImageData(BinaryData::logo_svg, BinaryData::logo_svgSize);
@@ -72,8 +72,8 @@ private:
     LevelMeter levelMeter;
 
     SpectrumAnalyzerGroup analyzerGroup{ 
-        apvtsParameters[LOW_MID_CUT].get() , 
-        apvtsParameters[MID_HIGH_CUT].get(), 
+        apvtsParameters[crossoverParameter(0)].get(), 
+        apvtsParameters[crossoverParameter(1)].get(), 
         audioProcessor.apvts, 
         audioProcessor.spectrumAnalyzer,
         lowDrive,
@@ -16,7 +16,7 @@ AttilaAudioProcessor::AttilaAudioProcessor()
     ),
     apvts(*this, nullptr, "Parameters", createParameterLayout()),
     distortion(),
-    spectrumAnalyzer(getSampleRate(), apvtsParameters[LOW_MID_CUT]->getDefault(), apvtsParameters[MID_HIGH_CUT]->getDefault())
+    spectrumAnalyzer(getSampleRate(), apvtsParameters[crossoverParameter(0)]->getDefault(), apvtsParameters[crossoverParameter(1)]->getDefault())
 #endif
 {
     if (!apvts.state.isValid()) {
@@ -30,9 +30,19 @@ AttilaAudioProcessor::AttilaAudioProcessor()
     for (auto& param : apvtsParameters) {
         param->castParameter(apvts);
     }
+
+    for (int i = 0; i < ParameterNames::PARAMETER_COUNT; ++i) {
+        auto id = apvtsParameters[i]->id.getParamID();
+        parameterValues[i] = apvts.getRawParameterValue(id);
+        parameterKeys[i] = id.toStdString();
+        jassert(parameterValues[i] != nullptr);
+    }
+
+    startTimerHz(30);
 }
 AttilaAudioProcessor::~AttilaAudioProcessor()
 {
+    stopTimer();
     apvts.state.removeListener(this);
 }
 
@@ -69,9 +79,12 @@ bool AttilaAudioProcessor::isMidiEffect() const
    #endif
 }
 
+// The crossover and resampler ringing after the input stops, plus the
+// latency, as the DSP works it out for the current settings.
 double AttilaAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    auto sampleRate = getSampleRate();
+    return sampleRate > 0.0 ? distortion.getTailSamples() / sampleRate : 0.0;
 }
 
 int AttilaAudioProcessor::getNumPrograms()
@@ -103,15 +116,10 @@ void AttilaAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock
 {
     int nChannels = getTotalNumInputChannels();
 
-    oversampling.numChannels = getTotalNumInputChannels();
-    oversampling.initProcessing(samplesPerBlock);
-    oversampling.reset();
-
-    setLatencySamples(oversampling.getLatencyInSamples());  
-
-    distortionParameters.set("sampleRate", sampleRate * (pow(2, oversampleFactor)));
+    distortionParameters.set("sampleRate", static_cast<float>(sampleRate));
     distortionParameters.set("blockSize", samplesPerBlock);
     distortionParameters.set("nChannels", nChannels);
+    distortionParameters.set("nonRealtime", isNonRealtime() ? 1.0f : 0.0f);
 
     spectrumAnalyzer.setSampleRate(sampleRate);
 
@@ -119,24 +127,51 @@ void AttilaAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock
         distortionParameters.set(param->id.getParamID().toStdString(), param->getDefault());
     }
 
-    distortion.prepare(distortionParameters);
+    // Start with the current band, crossover and oversampling settings, so
+    // the latency is right before the first block.
+    std::vector<int> settings{ ParameterNames::BANDS, ParameterNames::RENDER_QUALITY, ParameterNames::LINEAR_PHASE, ParameterNames::LINEAR_PHASE_CROSSOVER };
+    for (int band = 0; band < MAX_BANDS; ++band) {
+        settings.push_back(bandParameter(band, BAND_QUALITY));
+    }
+    for (auto setting : settings) {
+        distortionParameters.set(parameterKeys[setting], parameterValues[setting]->load());
+    }
+
+    {
+        const ScopedLock lock(rebuildLock);
+        distortion.prepare(distortionParameters);
+    }
+    setLatencySamples(distortion.getLatencySamples());
 
     levelL.store(0.0f);
     levelR.store(0.0f);
 }
 
+// Every key is in distortionParameters from prepareToPlay() on, so setting
+// them only overwrites values.
 void AttilaAudioProcessor::updateDSP()
 {
-    for (auto& param : apvtsParameters) {
-        distortionParameters.set(param->id.getParamID().toStdString(), param->get());
+    for (int i = 0; i < ParameterNames::PARAMETER_COUNT; ++i) {
+        distortionParameters.set(parameterKeys[i], parameterValues[i]->load(std::memory_order_relaxed));
     }
+    distortionParameters.set(nonRealtimeKey, isNonRealtime() ? 1.0f : 0.0f);
 
     distortion.update(distortionParameters);
 }
 
+void AttilaAudioProcessor::timerCallback()
+{
+    {
+        const ScopedTryLock lock(rebuildLock);
+        if (lock.isLocked()) distortion.rebuildTables();
+    }
+
+    auto latency = distortion.getLatencySamples();
+    if (latency != getLatencySamples()) setLatencySamples(latency);
+}
+
 void AttilaAudioProcessor::releaseResources()
 {
-    oversampling.reset();  // Make sure you reset oversampling
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -146,12 +181,10 @@ bool AttilaAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
     ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+    // Any layout up to MAX_CHANNELS channels, named or discrete: every
+    // channel is processed the same way, so their order does not matter.
+    auto channels = layouts.getMainOutputChannelSet().size();
+    if (channels < 1 || channels > MAX_CHANNELS)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -165,7 +198,10 @@ bool AttilaAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) c
 }
 #endif
 
-void AttilaAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
+// The DSP runs in single precision, so the processor does not claim
+// double precision support: double-precision hosts get float buffers
+// from the wrapper, as they would for any other single precision plugin.
+void AttilaAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer&)
 {
     ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
@@ -180,20 +216,13 @@ void AttilaAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer&
         updateDSP();
     }
 
-    dsp::AudioBlock<float> block(buffer);
-    auto oversampledBlock = oversampling.processSamplesUp(block);
-
-    float* outputBuffers[2] = { nullptr, nullptr };
-    outputBuffers[0] = oversampledBlock.getChannelPointer(0);
-    if (totalNumOutputChannels > 1) outputBuffers[1] = oversampledBlock.getChannelPointer(1);
-
     distortion.processBlock(
-        outputBuffers,
+        buffer.getArrayOfWritePointers(),
         buffer.getNumChannels(),
-        oversampledBlock.getNumSamples()
+        buffer.getNumSamples()
     );
 
-    oversampling.processSamplesDown(block);
+    dsp::AudioBlock<float> block(buffer);
     
     auto maxL = 0.0f, maxR = 0.0f;
 
@@ -258,189 +287,77 @@ AudioProcessorValueTreeState::ParameterLayout AttilaAudioProcessor::createParame
     };
     auto hzStringFromValue = [](float value, int) { return String(value) + " Hz"; };
 
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::INPUT_GAIN_1]->id,
-        apvtsParameters[ParameterNames::INPUT_GAIN_1]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 0.02f },
-        apvtsParameters[ParameterNames::INPUT_GAIN_1]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-    
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_1]->id,
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_1]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 0.02f },
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_1]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-    
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::DRIVE_1]->id,
-        apvtsParameters[ParameterNames::DRIVE_1]->displayValue,
-        NormalisableRange<float>{ 0.0f, 36.0f, 0.01f },
-        apvtsParameters[ParameterNames::DRIVE_1]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::KNEE_1]->id,
-        apvtsParameters[ParameterNames::KNEE_1]->displayValue,
-        NormalisableRange<float>{ 1.0f, MAX_KNEE, 0.01f },
-        apvtsParameters[ParameterNames::KNEE_1]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(truncateDecimals)
-    ));
-
-    layout.add(std::make_unique <AudioParameterInt>(
-        apvtsParameters[ParameterNames::BIT_1]->id,
-        apvtsParameters[ParameterNames::BIT_1]->displayValue,
-        1, 32,
-        apvtsParameters[ParameterNames::BIT_1]->getDefault()
-    ));
-
-    layout.add(std::make_unique <AudioParameterBool>(
-        apvtsParameters[ParameterNames::BYPASS_1]->id,
-        apvtsParameters[ParameterNames::BYPASS_1]->displayValue,
-        apvtsParameters[ParameterNames::BYPASS_1]->getDefault()
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::INPUT_GAIN_2]->id,
-        apvtsParameters[ParameterNames::INPUT_GAIN_2]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 1.0f },
-        apvtsParameters[ParameterNames::INPUT_GAIN_2]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_2]->id,
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_2]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 1.0f },
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_2]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::DRIVE_2]->id,
-        apvtsParameters[ParameterNames::DRIVE_2]->displayValue,
-        NormalisableRange<float>{ 0.0f, 36.0f, 0.01f },
-        apvtsParameters[ParameterNames::DRIVE_2]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::KNEE_2]->id,
-        apvtsParameters[ParameterNames::KNEE_2]->displayValue,
-        NormalisableRange<float>{ 1.0f, MAX_KNEE, 0.001f },
-        apvtsParameters[ParameterNames::KNEE_2]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(truncateDecimals)
-
-    ));
-
-    layout.add(std::make_unique <AudioParameterInt>(
-        apvtsParameters[ParameterNames::BIT_2]->id,
-        apvtsParameters[ParameterNames::BIT_2]->displayValue,
-        1, 32,
-        apvtsParameters[ParameterNames::BIT_2]->getDefault()
-    ));
-
-    layout.add(std::make_unique <AudioParameterBool>(
-        apvtsParameters[ParameterNames::BYPASS_2]->id,
-        apvtsParameters[ParameterNames::BYPASS_2]->displayValue,
-        apvtsParameters[ParameterNames::BYPASS_2]->getDefault()
-    ));
-
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::INPUT_GAIN_3]->id,
-        apvtsParameters[ParameterNames::INPUT_GAIN_3]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 1.0f },
-        apvtsParameters[ParameterNames::INPUT_GAIN_3]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
+    auto addFloat = [&](int parameter, NormalisableRange<float> range, std::function<String(float, int)> toString) {
+        layout.add(std::make_unique <AudioParameterFloat>(
+            apvtsParameters[parameter]->id,
+            apvtsParameters[parameter]->displayValue,
+            range,
+            apvtsParameters[parameter]->getDefault(),
+            AudioParameterFloatAttributes().withStringFromValueFunction(toString)
+        ));
+    };
 
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_3]->id,
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_3]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 1.0f },
-        apvtsParameters[ParameterNames::OUTPUT_GAIN_3]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
+    auto addBool = [&](int parameter) {
+        layout.add(std::make_unique <AudioParameterBool>(
+            apvtsParameters[parameter]->id,
+            apvtsParameters[parameter]->displayValue,
+            apvtsParameters[parameter]->getDefault()
+        ));
+    };
 
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::DRIVE_3]->id,
-        apvtsParameters[ParameterNames::DRIVE_3]->displayValue,
-        NormalisableRange<float>{ 0.0f, 36.0f, 0.01f },
-        apvtsParameters[ParameterNames::DRIVE_3]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
+    auto addChoice = [&](int parameter, const StringArray& choices) {
+        layout.add(std::make_unique <AudioParameterChoice>(
+            apvtsParameters[parameter]->id,
+            apvtsParameters[parameter]->displayValue,
+            choices,
+            static_cast<int>(apvtsParameters[parameter]->getDefault())
+        ));
+    };
 
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::KNEE_3]->id,
-        apvtsParameters[ParameterNames::KNEE_3]->displayValue,
-        NormalisableRange<float>{ 1.0f, MAX_KNEE, 0.001f },
-        apvtsParameters[ParameterNames::KNEE_3]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(truncateDecimals)
+    // Order follows ShaperCurves.
+    const StringArray curveNames{ "variable", "soft", "hard", "fold", "tube" };
+    // Index is the oversampling factor as a power of two.
+    const StringArray qualityNames{ "1x", "2x", "4x", "8x", "16x" };
+
+    for (int band = 0; band < MAX_BANDS; ++band) {
+        addFloat(bandParameter(band, BAND_INPUT_GAIN), { MIN_DB, MAX_DB, 0.02f }, dbStringFromValue);
+        addFloat(bandParameter(band, BAND_OUTPUT_GAIN), { MIN_DB, MAX_DB, 0.02f }, dbStringFromValue);
+        addFloat(bandParameter(band, BAND_DRIVE), { 0.0f, 36.0f, 0.01f }, dbStringFromValue);
+        addFloat(bandParameter(band, BAND_KNEE), { 1.0f, MAX_KNEE, 0.001f }, truncateDecimals);
+
+        layout.add(std::make_unique <AudioParameterInt>(
+            apvtsParameters[bandParameter(band, BAND_BIT)]->id,
+            apvtsParameters[bandParameter(band, BAND_BIT)]->displayValue,
+            1, 32,
+            apvtsParameters[bandParameter(band, BAND_BIT)]->getDefault()
+        ));
+
+        addBool(bandParameter(band, BAND_BYPASS));
+        addChoice(bandParameter(band, BAND_CURVE), curveNames);
+        addChoice(bandParameter(band, BAND_QUALITY), qualityNames);
+    }
 
-    ));
+    addFloat(ParameterNames::MIX, { 0.0f, 100.0f, 0.01f }, percentStringFromValue);
+    addFloat(ParameterNames::INPUT_GLOBAL, { MIN_DB, MAX_DB, 1.0f }, dbStringFromValue);
+    addFloat(ParameterNames::OUTPUT_GLOBAL, { MIN_DB, MAX_DB, 1.0f }, dbStringFromValue);
+    addBool(ParameterNames::BYPASS);
 
     layout.add(std::make_unique <AudioParameterInt>(
-        apvtsParameters[ParameterNames::BIT_3]->id,
-        apvtsParameters[ParameterNames::BIT_3]->displayValue,
-        1, 32,
-        apvtsParameters[ParameterNames::BIT_3]->getDefault()
+        apvtsParameters[ParameterNames::BANDS]->id,
+        apvtsParameters[ParameterNames::BANDS]->displayValue,
+        MIN_BANDS, MAX_BANDS,
+        apvtsParameters[ParameterNames::BANDS]->getDefault()
     ));
 
-    layout.add(std::make_unique <AudioParameterBool>(
-        apvtsParameters[ParameterNames::BYPASS_3]->id,
-        apvtsParameters[ParameterNames::BYPASS_3]->displayValue,
-        apvtsParameters[ParameterNames::BYPASS_3]->getDefault()
-    ));
-    
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::MIX]->id,
-        apvtsParameters[ParameterNames::MIX]->displayValue,
-        NormalisableRange<float>{ 0.0f, 100.0f, 0.01f },
-        apvtsParameters[ParameterNames::MIX]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(percentStringFromValue)
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::INPUT_GLOBAL]->id,
-        apvtsParameters[ParameterNames::INPUT_GLOBAL]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 1.0f },
-        apvtsParameters[ParameterNames::INPUT_GLOBAL]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-    
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::OUTPUT_GLOBAL]->id,
-        apvtsParameters[ParameterNames::OUTPUT_GLOBAL]->displayValue,
-        NormalisableRange<float>{ MIN_DB, MAX_DB, 1.0f },
-        apvtsParameters[ParameterNames::OUTPUT_GLOBAL]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(dbStringFromValue)
-    ));
-    
-    layout.add(std::make_unique <AudioParameterBool>(
-        apvtsParameters[ParameterNames::BYPASS]->id,
-        apvtsParameters[ParameterNames::BYPASS]->displayValue,
-        apvtsParameters[ParameterNames::BYPASS]->getDefault()
-    ));
-
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::LOW_MID_CUT]->id,
-        apvtsParameters[ParameterNames::LOW_MID_CUT]->displayValue,
-        NormalisableRange<float>{ 20.0f, 20000.0f, 1.0f, 0.3f },
-        apvtsParameters[ParameterNames::LOW_MID_CUT]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(hzStringFromValue)
-    ));
+    for (int split = 0; split < MAX_BANDS - 1; ++split) {
+        addFloat(crossoverParameter(split), { 20.0f, 20000.0f, 1.0f, 0.3f }, hzStringFromValue);
+    }
 
-    layout.add(std::make_unique <AudioParameterFloat>(
-        apvtsParameters[ParameterNames::MID_HIGH_CUT]->id,
-        apvtsParameters[ParameterNames::MID_HIGH_CUT]->displayValue,
-        NormalisableRange<float>{ 20.0f, 20000.0f, 1.0f, 0.3f },
-        apvtsParameters[ParameterNames::MID_HIGH_CUT]->getDefault(),
-        AudioParameterFloatAttributes().withStringFromValueFunction(hzStringFromValue)
-    ));
+    addBool(ParameterNames::TABLE_SHAPER);
+    addBool(ParameterNames::ANTIALIAS);
+    addChoice(ParameterNames::RENDER_QUALITY, qualityNames);
+    addBool(ParameterNames::LINEAR_PHASE);
+    addBool(ParameterNames::LINEAR_PHASE_CROSSOVER);
 
     return layout;
 }
@@ -20,60 +20,86 @@ using std::unordered_map;
 #define MAX_KNEE 24.0f
 
 
-enum ParameterNames{
-    INPUT_GAIN_1, OUTPUT_GAIN_1, 
-    DRIVE_1, KNEE_1,
-    BIT_1,
-    BYPASS_1,
-
-    INPUT_GAIN_2, OUTPUT_GAIN_2, 
-    DRIVE_2, KNEE_2,
-    BIT_2,
-    BYPASS_2,
-
-    INPUT_GAIN_3, OUTPUT_GAIN_3, 
-    DRIVE_3, KNEE_3,
-    BIT_3,
-    BYPASS_3,
+// Parameters every band has, MAX_BANDS times over. bandParameter() gives
+// the index into apvtsParameters; the IDs end in the band number from 1.
+enum BandParameterNames {
+    BAND_INPUT_GAIN, BAND_OUTPUT_GAIN,
+    BAND_DRIVE, BAND_KNEE,
+    BAND_BIT,
+    BAND_BYPASS,
+    BAND_CURVE,
+    BAND_QUALITY,
+    BAND_PARAMETER_COUNT
+};
 
+enum ParameterNames{
     MIX,
     INPUT_GLOBAL, OUTPUT_GLOBAL,
     BYPASS,
-
-    LOW_MID_CUT, MID_HIGH_CUT,
-    PARAMETER_COUNT
+    BANDS,
+    TABLE_SHAPER,
+    ANTIALIAS,
+    RENDER_QUALITY,
+    LINEAR_PHASE,
+    LINEAR_PHASE_CROSSOVER,
+    // MAX_BANDS - 1 crossover frequencies, see crossoverParameter().
+    CROSSOVERS,
+    BAND_PARAMETERS = CROSSOVERS + MAX_BANDS - 1,
+    PARAMETER_COUNT = BAND_PARAMETERS + MAX_BANDS * BAND_PARAMETER_COUNT
 };
 
-static std::array<std::unique_ptr<IAPVTSParameter>, ParameterNames::PARAMETER_COUNT> apvtsParameters{
-    std::make_unique<APVTSParameterFloat> ("inputGain1",      "in gain",      0.0f),
-    std::make_unique<APVTSParameterFloat> ("outputGain1",     "out gain",     0.0f),
-    std::make_unique<APVTSParameterFloat> ("drive1",          "drive",        0.0f),
-    std::make_unique<APVTSParameterFloat> ("knee1",           "knee",         1.0f),
-    std::make_unique<APVTSParameterInt>   ("bit1",            "bit",          32),
-    std::make_unique<APVTSParameterBool>  ("bypass1",         "LOW",          false),
-    std::make_unique<APVTSParameterFloat> ("inputGain2",      "in gain",      0.0f),
-    std::make_unique<APVTSParameterFloat> ("outputGain2",     "out gain",     0.0f),
-    std::make_unique<APVTSParameterFloat> ("drive2",          "drive",        0.0f),
-    std::make_unique<APVTSParameterFloat> ("knee2",           "knee",         1.0f),
-    std::make_unique<APVTSParameterInt>   ("bit2",            "bit",          32),
-    std::make_unique<APVTSParameterBool>  ("bypass2",         "MID",          false),
-    std::make_unique<APVTSParameterFloat> ("inputGain3",      "in gain",      0.0f),
-    std::make_unique<APVTSParameterFloat> ("outputGain3",     "out gain",     0.0f),
-    std::make_unique<APVTSParameterFloat> ("drive3",          "drive",        0.0f),
-    std::make_unique<APVTSParameterFloat> ("knee3",           "knee",         1.0f),
-    std::make_unique<APVTSParameterInt>   ("bit3",            "bit",          32),
-    std::make_unique<APVTSParameterBool>  ("bypass3",         "HIGH",         false),
-    std::make_unique<APVTSParameterFloat> ("mix",             "mix",          100.0f),
-    std::make_unique<APVTSParameterFloat> ("inputGain",       "input",        0.0f),
-    std::make_unique<APVTSParameterFloat> ("outputGain",      "output",       0.0f),
-    std::make_unique<APVTSParameterBool>  ("bypass",          "bypass",       false),
-    std::make_unique<APVTSParameterFloat> ("lowMidCut",       "Low/Mid Cut",  440.0f),
-    std::make_unique<APVTSParameterFloat> ("midHighCut",      "Mid/high Cut", 5000.0f)
-};
+inline int bandParameter(int band, BandParameterNames parameter) {
+    return BAND_PARAMETERS + band * BAND_PARAMETER_COUNT + parameter;
+}
+
+inline int crossoverParameter(int split) {
+    return CROSSOVERS + split;
+}
+
+// The first two are the three-band defaults, the rest keep ascending.
+static const std::array<float, MAX_BANDS - 1> crossoverDefaults{ 440.0f, 5000.0f, 8000.0f, 11000.0f, 14000.0f, 17000.0f, 19000.0f };
+
+inline std::array<std::unique_ptr<IAPVTSParameter>, ParameterNames::PARAMETER_COUNT> createApvtsParameters() {
+    std::array<std::unique_ptr<IAPVTSParameter>, ParameterNames::PARAMETER_COUNT> parameters;
+
+    parameters[MIX]            = std::make_unique<APVTSParameterFloat> ("mix",           "mix",            100.0f);
+    parameters[INPUT_GLOBAL]   = std::make_unique<APVTSParameterFloat> ("inputGain",     "input",          0.0f);
+    parameters[OUTPUT_GLOBAL]  = std::make_unique<APVTSParameterFloat> ("outputGain",    "output",         0.0f);
+    parameters[BYPASS]         = std::make_unique<APVTSParameterBool>  ("bypass",        "bypass",         false);
+    parameters[BANDS]          = std::make_unique<APVTSParameterInt>   ("bands",         "bands",          3);
+    parameters[TABLE_SHAPER]   = std::make_unique<APVTSParameterBool>  ("tableShaper",   "table shaper",   false);
+    parameters[ANTIALIAS]      = std::make_unique<APVTSParameterBool>  ("antialias",     "ADAA",           false);
+    parameters[RENDER_QUALITY] = std::make_unique<APVTSParameterChoice>("renderQuality", "render quality", 2);
+    parameters[LINEAR_PHASE]   = std::make_unique<APVTSParameterBool>  ("linearPhase",   "linear phase",   false);
+    parameters[LINEAR_PHASE_CROSSOVER] = std::make_unique<APVTSParameterBool>("linearPhaseCrossover", "linear phase crossover", false);
+
+    for (int split = 0; split < MAX_BANDS - 1; ++split) {
+        auto name = "Cut " + String(split + 1) + "/" + String(split + 2);
+        parameters[crossoverParameter(split)] = std::make_unique<APVTSParameterFloat>(getCrossoverID(split), name, crossoverDefaults[split]);
+    }
+
+    for (int band = 0; band < MAX_BANDS; ++band) {
+        auto suffix = String(band + 1);
+        auto name = "BAND " + suffix;
+        parameters[bandParameter(band, BAND_INPUT_GAIN)]  = std::make_unique<APVTSParameterFloat> ("inputGain" + suffix,  "in gain",           0.0f);
+        parameters[bandParameter(band, BAND_OUTPUT_GAIN)] = std::make_unique<APVTSParameterFloat> ("outputGain" + suffix, "out gain",          0.0f);
+        parameters[bandParameter(band, BAND_DRIVE)]       = std::make_unique<APVTSParameterFloat> ("drive" + suffix,      "drive",             0.0f);
+        parameters[bandParameter(band, BAND_KNEE)]        = std::make_unique<APVTSParameterFloat> ("knee" + suffix,       "knee",              1.0f);
+        parameters[bandParameter(band, BAND_BIT)]         = std::make_unique<APVTSParameterInt>   ("bit" + suffix,        "bit",               32);
+        parameters[bandParameter(band, BAND_BYPASS)]      = std::make_unique<APVTSParameterBool>  ("bypass" + suffix,     name,                false);
+        parameters[bandParameter(band, BAND_CURVE)]       = std::make_unique<APVTSParameterChoice>("curve" + suffix,      name + " curve",     0);
+        parameters[bandParameter(band, BAND_QUALITY)]     = std::make_unique<APVTSParameterChoice>("quality" + suffix,    name + " quality",   2);
+    }
+
+    return parameters;
+}
+
+static std::array<std::unique_ptr<IAPVTSParameter>, ParameterNames::PARAMETER_COUNT> apvtsParameters = createApvtsParameters();
 
 class AttilaAudioProcessor  : 
     public juce::AudioProcessor,
-    public ValueTree::Listener
+    public ValueTree::Listener,
+    private Timer
 {
 public:
     //==============================================================================
@@ -132,12 +158,31 @@ private:
     }
 
     void updateDSP();
+
+    // This instance's parameter values and their DSP keys by ParameterNames
+    // index, looked up once in the constructor: updateDSP() runs on the
+    // audio thread and must neither search the tree nor build strings.
+    // apvtsParameters is shared by every instance, so its pointers cannot
+    // be used here.
+    std::array<std::atomic<float>*, ParameterNames::PARAMETER_COUNT> parameterValues{};
+    std::array<std::string, ParameterNames::PARAMETER_COUNT> parameterKeys;
+    const std::string nonRealtimeKey{ "nonRealtime" };
+
     DSPParameters<float> distortionParameters;
 
-    MultibandDistortion distortion;
+    // Housekeeping that must stay off the audio thread: building the
+    // waveshaper tables and crossover kernels requested by the DSP, and
+    // reporting the latency that comes with the crossover and band
+    // oversampling settings.
+    void timerCallback() override;
 
-    size_t oversampleFactor = 2;
-    dsp::Oversampling<float> oversampling{ 2, oversampleFactor, juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR, false};
+    // Held while preparing the DSP and while the timer rebuilds its tables,
+    // so a rebuild never runs on memory prepare() is replacing. The timer
+    // skips a tick rather than wait for it.
+    juce::CriticalSection rebuildLock;
+
+    // Oversampling runs per band inside the DSP, see MultibandDistortion.
+    MultibandDistortion distortion;
 
     std::unique_ptr<PresetManager>presetManager;
 
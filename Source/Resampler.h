@@ -0,0 +1,390 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+// Oversampling factors are powers of two, 0 (1x) to 4 (16x).
+#define MAX_OVERSAMPLING_FACTOR 4
+#define MAX_HALFBAND_TAPS 32
+#define MAX_ALLPASS_COEFFICIENTS 8
+// Level, relative to an impulse, below which a response counts as died
+// away. 180 dB down leaves 120 dB even behind the most gain the band and
+// global stages can add.
+#define TAIL_LEVEL 1.0e-9
+
+// minimumPhase: polyphase allpass IIR halfbands, short and cheap, with a
+// phase response that bends near the top of the band.
+// linearPhase: symmetric halfband FIRs, longer latency but no phase
+// distortion in the passband.
+enum class ResamplerDesign { minimumPhase, linearPhase };
+
+// Coefficients of one 2x stage. Each design keeps the passband up to 0.2
+// of the stage's higher rate (17.6 kHz at 44.1 kHz for the first stage)
+// and rejects at least 90 dB from where it would alias back into it.
+// Later stages only guard the band the first one let through, so they
+// can be much shorter.
+struct HalfbandDesign
+{
+    // FIR: the non-zero taps besides the centre of a halfband of length
+    // 2 * numTaps - 1, doubled so they sum to 1. The centre tap is 1/2
+    // and turns into a plain delay of numTaps / 2 - 1 samples.
+    int numTaps{ 0 };
+    std::array<float, MAX_HALFBAND_TAPS> taps{};
+
+    // IIR: first-order allpass coefficients at the lower rate; even
+    // indices form one polyphase path, odd indices the other.
+    int numCoefficients{ 0 };
+    std::array<float, MAX_ALLPASS_COEFFICIENTS> coefficients{};
+
+    // Delay of up- and then downsampling through the stage, in samples at
+    // its lower rate. Exact for the FIRs; for the IIRs it is the group
+    // delay at DC.
+    double latency{ 0.0 };
+
+    // How long an impulse through up- and then downsampling takes to stay
+    // below TAIL_LEVEL, in samples at the lower rate. The FIRs' whole
+    // length; for the IIRs a bound from each allpass decaying on its own.
+    double tail{ 0.0 };
+
+    static HalfbandDesign fir(int numTaps, double beta) {
+        HalfbandDesign design;
+        design.numTaps = numTaps;
+
+        auto length = 2 * numTaps - 1;
+        auto sum = 0.0;
+        std::array<double, MAX_HALFBAND_TAPS> taps{};
+        for (int q = 0; q < numTaps; ++q) {
+            // Tap 2q of the full filter, an odd distance from the centre.
+            auto offset = 2 * q - (numTaps - 1);
+            auto x = 0.5 * juce::MathConstants<double>::pi * offset;
+            auto position = 2.0 * (2 * q) / (length - 1) - 1.0;
+            taps[q] = std::sin(x) / x * besselI0(beta * std::sqrt(1.0 - position * position));
+            sum += taps[q];
+        }
+        for (int q = 0; q < numTaps; ++q) {
+            design.taps[q] = static_cast<float>(taps[q] / sum);
+        }
+        design.latency = numTaps - 1;
+        design.tail = 2.0 * design.latency + 1.0;
+        return design;
+    }
+
+    // Valenzuela and Constantinides' allpass halfband for a given number
+    // of coefficients and transition width (relative to the higher rate),
+    // computed the way Laurent de Soras' HIIR library does.
+    static HalfbandDesign iir(int numCoefficients, double transition) {
+        HalfbandDesign design;
+        design.numCoefficients = numCoefficients;
+
+        auto pi = juce::MathConstants<double>::pi;
+        auto k = std::pow(std::tan((1.0 - transition * 2.0) * pi / 4.0), 2.0);
+        auto kk = std::pow(1.0 - k * k, 0.25);
+        auto e = 0.5 * (1.0 - kk) / (1.0 + kk);
+        auto e4 = std::pow(e, 4.0);
+        auto q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4)));
+        auto order = 2 * numCoefficients + 1;
+
+        for (int index = 0; index < numCoefficients; ++index) {
+            auto c = index + 1;
+            auto numerator = 0.0, denominator = 0.0;
+            for (int i = 0; i < 16; ++i) {
+                numerator += ((i % 2 == 0) ? 1.0 : -1.0) * std::pow(q, i * (i + 1)) * std::sin((2 * i + 1) * c * pi / order);
+            }
+            for (int i = 1; i < 16; ++i) {
+                denominator += ((i % 2 == 1) ? -1.0 : 1.0) * std::pow(q, i * i) * std::cos(2 * i * c * pi / order);
+            }
+            auto w = numerator * std::pow(q, 0.25) / (denominator + 0.5);
+            auto w2 = w * w;
+            auto x = std::sqrt((1.0 - w2 * k) * (1.0 - w2 / k)) / (1.0 + w2);
+            auto coefficient = (1.0 - x) / (1.0 + x);
+
+            design.coefficients[index] = static_cast<float>(coefficient);
+            // Up- then downsampling runs the signal through both paths.
+            design.latency += (1.0 - coefficient) / (1.0 + coefficient);
+            design.tail += std::log(TAIL_LEVEL) / std::log(std::abs(coefficient));
+        }
+        return design;
+    }
+
+    static double besselI0(double x) {
+        auto sum = 1.0, term = 1.0;
+        for (int i = 1; i < 32; ++i) {
+            term *= (x / (2.0 * i)) * (x / (2.0 * i));
+            sum += term;
+        }
+        return sum;
+    }
+};
+
+// Stage designs for both kinds, built once on first use.
+struct HalfbandDesigns
+{
+    std::array<HalfbandDesign, MAX_OVERSAMPLING_FACTOR> minimumPhase;
+    std::array<HalfbandDesign, MAX_OVERSAMPLING_FACTOR> linearPhase;
+
+    HalfbandDesigns() {
+        minimumPhase[0] = HalfbandDesign::iir(6, 0.1);
+        minimumPhase[1] = HalfbandDesign::iir(3, 0.3);
+        linearPhase[0] = HalfbandDesign::fir(30, 9.0);
+        linearPhase[1] = HalfbandDesign::fir(12, 9.0);
+        for (int stage = 2; stage < MAX_OVERSAMPLING_FACTOR; ++stage) {
+            minimumPhase[stage] = HalfbandDesign::iir(2, 0.4);
+            linearPhase[stage] = HalfbandDesign::fir(10, 8.5);
+        }
+    }
+
+    static const HalfbandDesign& get(ResamplerDesign design, int stage) {
+        static const HalfbandDesigns designs;
+        return design == ResamplerDesign::linearPhase ? designs.linearPhase[stage] : designs.minimumPhase[stage];
+    }
+};
+
+// One 2x stage, up and down, with its own state for each direction. T is
+// the sample type; with a juce::dsp::SIMDRegister every lane is an
+// independent signal.
+template <typename T>
+struct HalfbandStage
+{
+    const HalfbandDesign* design{ nullptr };
+    bool linearPhase{ false };
+
+    // FIR inputs are written twice, at position and position + numTaps, so
+    // the newest numTaps of them are always contiguous from position on.
+    std::array<T, 2 * MAX_HALFBAND_TAPS> upHistory{};
+    std::array<T, 2 * MAX_HALFBAND_TAPS> evenHistory{};
+    std::array<T, 2 * MAX_HALFBAND_TAPS> oddHistory{};
+    int upPosition{ 0 };
+    int downPosition{ 0 };
+
+    std::array<T, MAX_ALLPASS_COEFFICIENTS> upInputs{}, upOutputs{};
+    std::array<T, MAX_ALLPASS_COEFFICIENTS> downInputs{}, downOutputs{};
+
+    void reset() {
+        upHistory.fill(T{});
+        evenHistory.fill(T{});
+        oddHistory.fill(T{});
+        upPosition = downPosition = 0;
+        upInputs.fill(T{});
+        upOutputs.fill(T{});
+        downInputs.fill(T{});
+        downOutputs.fill(T{});
+    }
+
+    // 2 * numSamples outputs. output may start numSamples before input:
+    // every input is read before the two outputs that can overwrite it.
+    void upsample(const T* input, T* output, int numSamples) {
+        if (linearPhase) {
+            auto n = design->numTaps;
+            for (int i = 0; i < numSamples; ++i) {
+                auto* window = push(upHistory, upPosition, n, input[i]);
+                output[2 * i] = convolve(window, n);
+                output[2 * i + 1] = window[n / 2 - 1];
+            }
+        }
+        else {
+            for (int i = 0; i < numSamples; ++i) {
+                auto a = input[i], b = input[i];
+                for (int c = 0; c < design->numCoefficients; c += 2) a = allpass(a, c, upInputs, upOutputs);
+                for (int c = 1; c < design->numCoefficients; c += 2) b = allpass(b, c, upInputs, upOutputs);
+                output[2 * i] = a;
+                output[2 * i + 1] = b;
+            }
+        }
+    }
+
+    // numSamples outputs from 2 * numSamples inputs; output may be input.
+    void downsample(const T* input, T* output, int numSamples) {
+        if (linearPhase) {
+            auto n = design->numTaps;
+            for (int i = 0; i < numSamples; ++i) {
+                auto even = input[2 * i], odd = input[2 * i + 1];
+                auto* evenWindow = push(evenHistory, downPosition, n, even);
+                auto* oddWindow = oddHistory.data() + downPosition;
+                oddWindow[0] = oddWindow[n] = odd;
+                output[i] = (convolve(evenWindow, n) + oddWindow[n / 2]) * 0.5f;
+            }
+        }
+        else {
+            for (int i = 0; i < numSamples; ++i) {
+                auto b = input[2 * i], a = input[2 * i + 1];
+                for (int c = 0; c < design->numCoefficients; c += 2) a = allpass(a, c, downInputs, downOutputs);
+                for (int c = 1; c < design->numCoefficients; c += 2) b = allpass(b, c, downInputs, downOutputs);
+                output[i] = (a + b) * 0.5f;
+            }
+        }
+    }
+
+private:
+    static const T* push(std::array<T, 2 * MAX_HALFBAND_TAPS>& history, int& position, int n, T x) {
+        position = (position == 0 ? n : position) - 1;
+        history[position] = x;
+        history[position + n] = x;
+        return history.data() + position;
+    }
+
+    // The taps are symmetric, so mirrored inputs share a multiply.
+    T convolve(const T* window, int n) const {
+        auto* taps = design->taps.data();
+        auto sum = (window[0] + window[n - 1]) * taps[0];
+        for (int q = 1; q < n / 2; ++q) {
+            sum += (window[q] + window[n - 1 - q]) * taps[q];
+        }
+        return sum;
+    }
+
+    T allpass(T x, int c, std::array<T, MAX_ALLPASS_COEFFICIENTS>& inputs, std::array<T, MAX_ALLPASS_COEFFICIENTS>& outputs) const {
+        auto y = (x - outputs[c]) * design->coefficients[c] + inputs[c];
+        inputs[c] = x;
+        outputs[c] = y;
+        return y;
+    }
+};
+
+// First-order allpass with a group delay of delay samples at DC, after
+// Thiran. Stable for any delay above zero; the delay stays flattest over
+// frequency between 0.5 and 1.5 samples.
+template <typename T>
+struct FractionalDelay
+{
+    float coefficient{ 1.0f };
+    T input{}, output{};
+
+    FractionalDelay() = default;
+    explicit FractionalDelay(double delay) { prepare(delay); }
+
+    void prepare(double delay) {
+        jassert(delay > 0.0);
+        coefficient = static_cast<float>((1.0 - delay) / (1.0 + delay));
+        reset();
+    }
+
+    void reset() {
+        input = output = T{};
+    }
+
+    T process(T x) {
+        auto y = (x - output) * coefficient + input;
+        input = x;
+        output = y;
+        return y;
+    }
+
+    // Samples until an impulse stays below TAIL_LEVEL.
+    double getTailLength() const {
+        return coefficient == 0.0f ? 1.0 : 1.0 + std::log(TAIL_LEVEL) / std::log(std::abs(static_cast<double>(coefficient)));
+    }
+};
+
+// Cascade of 2x stages for a factor of 2^factor. All state lives inside,
+// so prepare() and reset() neither allocate nor block and can run on the
+// audio thread. A delay at the highest rate rounds the latency up to
+// whole base-rate samples: whole samples of it for the linear-phase
+// stages, plus a fractional allpass for the remainder the IIR stages
+// leave. The IIRs' delay is only flat at low frequencies, so for them the
+// latency is whole at DC, which is what bands at different factors are
+// aligned by.
+template <typename T>
+class Resampler
+{
+    std::array<HalfbandStage<T>, MAX_OVERSAMPLING_FACTOR> stages;
+    std::array<T, 1 << MAX_OVERSAMPLING_FACTOR> padHistory{};
+    int padDelay{ 0 };
+    int padPosition{ 0 };
+    FractionalDelay<T> padFraction;
+    bool fractional{ false };
+    int factor{ 0 };
+    int latency{ 0 };
+    double tail{ 0.0 };
+
+public:
+
+    // shaperDelay is the delay, in samples at the highest rate, of
+    // whatever runs between upsample() and downsample(). The pad makes up
+    // the rest to whole base-rate samples, so getLatency() includes it.
+    void prepare(int newFactor, ResamplerDesign design, int shaperDelay = 0) {
+        jassert(newFactor > 0 && newFactor <= MAX_OVERSAMPLING_FACTOR);
+        factor = newFactor;
+
+        auto total = shaperDelay / static_cast<double>(1 << factor);
+        tail = total;
+        for (int stage = 0; stage < factor; ++stage) {
+            stages[stage].design = &HalfbandDesigns::get(design, stage);
+            stages[stage].linearPhase = design == ResamplerDesign::linearPhase;
+            total += stages[stage].design->latency / static_cast<double>(1 << stage);
+            tail += stages[stage].design->tail / static_cast<double>(1 << stage);
+        }
+
+        // The pad in samples at the highest rate. The allpass takes the
+        // fraction, with a whole sample from the plain delay if there is
+        // one to spare, so its own delay stays at 0.5 or more.
+        auto rate = static_cast<double>(1 << factor);
+        auto whole = std::ceil(total - 1.0e-9);
+        auto pad = (whole - total) * rate;
+        padDelay = static_cast<int>(std::floor(pad + 1.0e-9));
+        auto fraction = pad - padDelay;
+        fractional = fraction > 1.0e-9;
+        if (fractional) {
+            if (fraction < 0.5 && padDelay > 0) {
+                --padDelay;
+                fraction += 1.0;
+            }
+            padFraction.prepare(fraction);
+            tail += padFraction.getTailLength() / rate;
+        }
+        latency = static_cast<int>(whole);
+        tail += padDelay / rate;
+        reset();
+    }
+
+    void reset() {
+        for (auto& stage : stages) stage.reset();
+        padHistory.fill(T{});
+        padPosition = 0;
+        padFraction.reset();
+    }
+
+    int getFactor() const { return factor; }
+
+    // Round trip in base-rate samples, a whole number. For minimumPhase it
+    // is the group delay at DC.
+    int getLatency() const { return latency; }
+
+    // Base-rate samples after the last input before the output stays
+    // below TAIL_LEVEL, latency included.
+    double getTailLength() const { return tail; }
+
+    // numSamples inputs, numSamples << factor outputs. Each stage writes
+    // into the tail of output, so no intermediate buffers are needed.
+    void upsample(const T* input, T* output, int numSamples) {
+        auto end = output + (numSamples << factor);
+        for (int stage = 0; stage < factor; ++stage) {
+            auto* stageOutput = end - (numSamples << (stage + 1));
+            stages[stage].upsample(input, stageOutput, numSamples << stage);
+            input = stageOutput;
+        }
+    }
+
+    // numSamples << factor inputs, overwritten on the way, numSamples
+    // outputs. output may be input.
+    void downsample(T* input, T* output, int numSamples) {
+        auto numFrames = numSamples << factor;
+        if (padDelay > 0) {
+            auto mask = static_cast<int>(padHistory.size()) - 1;
+            for (int i = 0; i < numFrames; ++i) {
+                padHistory[padPosition] = input[i];
+                input[i] = padHistory[(padPosition - padDelay) & mask];
+                padPosition = (padPosition + 1) & mask;
+            }
+        }
+        if (fractional) {
+            for (int i = 0; i < numFrames; ++i) {
+                input[i] = padFraction.process(input[i]);
+            }
+        }
+        for (int stage = factor - 1; stage > 0; --stage) {
+            stages[stage].downsample(input, input, numSamples << stage);
+        }
+        stages[0].downsample(input, output, numSamples);
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "LaneUtils.h"
+
+// Fixed shaper curves selectable per band. Each one maps the driven input
+// to roughly [-1, 1] with unity slope at zero, so switching curves keeps
+// the small-signal level. integral() is an antiderivative for ADAA; any
+// constant offset works as long as it is continuous. The variable-hardness
+// curve depends on the knee and the waveshaper tables and stays in
+// LaneDistortion.
+enum ShaperCurves { VARIABLE_CURVE, SOFT_CURVE, HARD_CURVE, FOLD_CURVE, TUBE_CURVE, CURVE_COUNT };
+
+template <int Curve>
+struct ShaperCurve;
+
+// tanh-style soft clip: the rational approximation x (27 + x^2) / (27 + 9 x^2)
+// meets +-1 with zero slope at |x| = 3.
+template <>
+struct ShaperCurve<SOFT_CURVE>
+{
+    static Lane apply(Lane x) {
+        x = Lane::min(Lane::max(x, Lane::expand(-3.0f)), Lane::expand(3.0f));
+        auto x2 = x * x;
+        return laneDivide(x * (x2 + 27.0f), x2 * 9.0f + 27.0f);
+    }
+
+    // x^2 / 18 + 4/3 ln(1 + x^2 / 3) inside +-3, linear past it.
+    static Lane integral(Lane x) {
+        auto c = Lane::min(Lane::max(x, Lane::expand(-3.0f)), Lane::expand(3.0f));
+        auto c2 = c * c;
+        auto inner = c2 * static_cast<float>(1.0 / 18.0)
+            + laneLog2<FastMath::Accuracy::precise>(c2 * static_cast<float>(1.0 / 3.0) + 1.0f) * static_cast<float>(4.0 / 3.0 * 0.69314718055994531);
+        return inner + Lane::abs(x) - Lane::abs(c);
+    }
+};
+
+template <>
+struct ShaperCurve<HARD_CURVE>
+{
+    static Lane apply(Lane x) {
+        return Lane::min(Lane::max(x, Lane::expand(-1.0f)), Lane::expand(1.0f));
+    }
+
+    static Lane integral(Lane x) {
+        auto c = apply(x);
+        return c * c * 0.5f + Lane::abs(x) - Lane::abs(c);
+    }
+};
+
+// Reflects everything past +-1 back into range: a triangle wave of period
+// 4 that is the identity on [-1, 1].
+template <>
+struct ShaperCurve<FOLD_CURVE>
+{
+    static Lane apply(Lane x) {
+        auto shifted = x + 1.0f;
+        auto wrapped = shifted - laneFloor(shifted * 0.25f) * 4.0f;
+        return Lane::expand(1.0f) - Lane::abs(wrapped - 2.0f);
+    }
+
+    // The triangle integrates to zero over a period, so the antiderivative
+    // is periodic too: w^2/2 - w on the rising half, 3 (w - 2) - (w^2 - 4) / 2
+    // on the falling one.
+    static Lane integral(Lane x) {
+        auto shifted = x + 1.0f;
+        auto w = shifted - laneFloor(shifted * 0.25f) * 4.0f;
+        auto rising = w * w * 0.5f - w;
+        auto falling = (w - 2.0f) * 3.0f - (w * w - 4.0f) * 0.5f;
+        return laneSelect(Lane::lessThan(w, Lane::expand(2.0f)), rising, falling);
+    }
+};
+
+// Asymmetric soft clip: the negative half saturates earlier and lower,
+// reaching -2/3 at x = -2 where the positive half reaches 1 at x = 3. The
+// asymmetry adds the even harmonics of a single-ended tube stage.
+template <>
+struct ShaperCurve<TUBE_CURVE>
+{
+    static Lane apply(Lane x) {
+        auto negative = Lane::lessThan(x, Lane::expand(0.0f));
+        auto scale = laneSelect(negative, Lane::expand(1.5f), Lane::expand(1.0f));
+        auto inverse = laneSelect(negative, Lane::expand(2.0f / 3.0f), Lane::expand(1.0f));
+        return ShaperCurve<SOFT_CURVE>::apply(x * scale) * inverse;
+    }
+
+    // Substituting 1.5 x on the negative half scales F by (2/3)^2.
+    static Lane integral(Lane x) {
+        auto negative = Lane::lessThan(x, Lane::expand(0.0f));
+        auto scale = laneSelect(negative, Lane::expand(1.5f), Lane::expand(1.0f));
+        auto factor = laneSelect(negative, Lane::expand(4.0f / 9.0f), Lane::expand(1.0f));
+        return ShaperCurve<SOFT_CURVE>::integral(x * scale) * factor;
+    }
+};
@@ -2,6 +2,7 @@
 
 #include <JuceHeader.h>
 #include <cmath>
+#include "FastMath.h"
 
 template<typename T>
 inline static void castParameter(AudioProcessorValueTreeState& apvts,
@@ -13,11 +14,13 @@ inline static void castParameter(AudioProcessorValueTreeState& apvts,
 }
 
 inline float linearToDb(float input) {
-    return 20.0f * log10f(fabsf(input) + 0.000001f);
+    // 20 * log10(x) = 20 * log10(2) * log2(x)
+    return 6.02059991f * FastMath::log2<FastMath::Accuracy::precise>(fabsf(input) + 0.000001f);
 }
 
 inline float dbToLinear(float input) {
-    return powf(10.0f, input / 20.0f);
+    // 10^(x / 20) = 2^(x * log2(10) / 20)
+    return FastMath::exp2<FastMath::Accuracy::precise>(input * 0.166096404f);
 }
 
 inline float sign(float x) {
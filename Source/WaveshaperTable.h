@@ -0,0 +1,130 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <algorithm>
+
+#define WAVESHAPER_TABLE_SIZE 2048
+
+// Transfer curve of the variable-hardness clipper for one knee, sampled
+// uniformly over t = |x| / (1 + |x|). The mapping squeezes the whole input
+// range into [0, 1): most points land around the knee at |x| = 1 and the
+// tail ends at exactly zero for |x| -> inf, so lookups need no clamping.
+// With linear interpolation the error against the analytic curve stays
+// below 1.2e-5 for every knee in [1, 24].
+// integrals holds the antiderivative for ADAA at the same points. It is
+// read with cubic Hermite interpolation over values as slopes, so its
+// derivative is continuous and matches the curve at every table point.
+struct WaveshaperTable
+{
+    float knee{ 0.0f };
+    std::array<float, WAVESHAPER_TABLE_SIZE + 2> values{};
+    std::array<float, WAVESHAPER_TABLE_SIZE> integrals{};
+
+    // Input level of table point i.
+    static float pointAt(int i) {
+        return static_cast<float>(i) / static_cast<float>(WAVESHAPER_TABLE_SIZE - i);
+    }
+
+    // Reference curve, in double so |x|^knee cannot overflow while building.
+    static double transfer(double x, double k) {
+        auto u = std::pow(std::abs(x), k);
+        return std::pow(u / (1.0 + 0.28 * u * u), 1.0 / k);
+    }
+
+    void build(float k) {
+        for (int i = 0; i < WAVESHAPER_TABLE_SIZE; ++i) {
+            auto t = static_cast<double>(i) / WAVESHAPER_TABLE_SIZE;
+            values[i] = static_cast<float>(transfer(t / (1.0 - t), k));
+        }
+        values[WAVESHAPER_TABLE_SIZE] = 0.0f;
+        values[WAVESHAPER_TABLE_SIZE + 1] = 0.0f;
+
+        // Simpson's rule between neighbouring points, accumulated in double.
+        auto integral = 0.0;
+        integrals[0] = 0.0f;
+        for (int i = 1; i < WAVESHAPER_TABLE_SIZE; ++i) {
+            auto a = static_cast<double>(i - 1) / (WAVESHAPER_TABLE_SIZE - i + 1);
+            auto b = static_cast<double>(i) / (WAVESHAPER_TABLE_SIZE - i);
+            auto h = (b - a) / 8.0;
+            auto sum = transfer(a, k) + transfer(b, k);
+            for (int j = 1; j < 8; ++j) sum += (j % 2 == 1 ? 4.0 : 2.0) * transfer(a + j * h, k);
+            integral += sum * h / 3.0;
+            integrals[i] = static_cast<float>(integral);
+        }
+        knee = k;
+    }
+
+    float lookup(float x) const {
+        auto a = std::abs(x);
+        // NaN compares false and ends up on the zero guard point.
+        auto position = std::min(static_cast<float>(WAVESHAPER_TABLE_SIZE), a / (1.0f + a) * WAVESHAPER_TABLE_SIZE);
+        auto index = static_cast<int>(position);
+        auto fraction = position - static_cast<float>(index);
+        auto y = values[index] + fraction * (values[index + 1] - values[index]);
+        return x < 0.0f ? -y : y;
+    }
+
+    // Antiderivative of lookup(), even in x. Past the last point the curve
+    // is taken as constant, which is within 2e-3 of it.
+    float lookupIntegral(float x) const {
+        auto a = std::abs(x);
+        auto last = WAVESHAPER_TABLE_SIZE - 1;
+        auto position = std::min(static_cast<float>(last), a / (1.0f + a) * WAVESHAPER_TABLE_SIZE);
+        auto index = static_cast<int>(position);
+        if (index >= last) {
+            return integrals[last] + values[last] * (a - pointAt(last));
+        }
+
+        auto x0 = pointAt(index);
+        auto h = pointAt(index + 1) - x0;
+        auto s = (a - x0) / h;
+        auto s2 = s * s;
+        auto s3 = s2 * s;
+        return integrals[index] * (2.0f * s3 - 3.0f * s2 + 1.0f)
+            + values[index] * h * (s3 - 2.0f * s2 + s)
+            + integrals[index + 1] * (3.0f * s2 - 2.0f * s3)
+            + values[index + 1] * h * (s3 - s2);
+    }
+};
+
+// Double-buffered table for one band. The audio thread asks for a knee
+// with request() and picks up the latest finished table with acquire().
+// rebuild() runs off the audio thread: it only writes into the slot the
+// audio thread is not using, and only after the audio thread has
+// acknowledged the previously published table, so a table is never
+// rewritten while it can still be read.
+class WaveshaperTableCache
+{
+    std::array<WaveshaperTable, 2> tables;
+    std::atomic<int> published{ -1 };
+    std::atomic<int> acknowledged{ -1 };
+    std::atomic<float> requestedKnee{ 0.0f };
+
+public:
+
+    void request(float knee) {
+        requestedKnee.store(knee, std::memory_order_relaxed);
+    }
+
+    const WaveshaperTable* acquire() {
+        auto index = published.load(std::memory_order_acquire);
+        acknowledged.store(index, std::memory_order_release);
+        return index < 0 ? nullptr : &tables[index];
+    }
+
+    void rebuild() {
+        auto knee = requestedKnee.load(std::memory_order_relaxed);
+        auto current = published.load(std::memory_order_acquire);
+
+        if (knee <= 0.0f) return;
+        if (current >= 0 && tables[current].knee == knee) return;
+        if (acknowledged.load(std::memory_order_acquire) != current) return;
+
+        auto next = current == 0 ? 1 : 0;
+        tables[next].build(knee);
+        published.store(next, std::memory_order_release);
+    }
+};
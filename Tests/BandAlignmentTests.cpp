@@ -0,0 +1,102 @@
+#include <JuceHeader.h>
+#include "../Source/MultibandDistortion.h"
+
+namespace
+{
+    const float sampleRate = 44100.0f;
+    const int numSamples = 8192;
+    // A few cycles per numSamples / 2, well below the cut.
+    const double frequency = 4.0 / (numSamples / 2);
+
+    DSPParameters<float> makeParameters(float mixPercent, int quality, bool antialias, int bit) {
+        DSPParameters<float> params;
+        params.set("sampleRate", sampleRate);
+        params.set("blockSize", static_cast<float>(CONTROL_BLOCK_SIZE));
+        params.set("nChannels", 1.0f);
+        params.set("bands", 2.0f);
+        params.set("lowMidCut", 1000.0f);
+        params.set("mix", mixPercent);
+        params.set("antialias", antialias ? 1.0f : 0.0f);
+
+        for (auto key : { "inputGain", "outputGain", "bypass", "nonRealtime", "renderQuality", "linearPhase", "linearPhaseCrossover", "tableShaper" }) {
+            params.set(key, 0.0f);
+        }
+
+        for (int band = 0; band < MAX_BANDS; ++band) {
+            auto suffix = std::to_string(band + 1);
+            for (auto key : { "inputGain", "outputGain", "drive", "bypass", "curve" }) {
+                params.set(key + suffix, 0.0f);
+            }
+            params.set("knee" + suffix, 1.0f);
+            params.set("bit" + suffix, static_cast<float>(bit));
+            params.set("quality" + suffix, static_cast<float>(quality));
+        }
+        return params;
+    }
+}
+
+// Bands at every factor, with and without ADAA and the bitcrusher, have to
+// come out getLatencySamples() late, like the dry signal, or mixing them
+// would comb filter. The input is quiet enough for the shaper to be all
+// but linear, so what is left is the delay of each path.
+class BandAlignmentTests : public juce::UnitTest
+{
+public:
+    BandAlignmentTests() : juce::UnitTest("Band alignment", "DSP") {}
+
+    void runTest() override {
+        beginTest("dry signal");
+        {
+            MultibandDistortion distortion;
+            auto params = makeParameters(0.0f, 2, true, 32);
+            distortion.prepare(params);
+            expectWithinAbsoluteError(measureDelay(distortion), static_cast<double>(distortion.getLatencySamples()), 1.0e-3);
+        }
+
+        // The crossover's own phase shift is the same in every setting.
+        auto reference = 0.0;
+        {
+            MultibandDistortion distortion;
+            auto params = makeParameters(100.0f, 0, false, 32);
+            distortion.prepare(params);
+            reference = measureDelay(distortion) - distortion.getLatencySamples();
+        }
+
+        for (auto antialias : { false, true }) {
+            for (auto bit : { 32, 24 }) {
+                for (int quality = 0; quality <= MAX_OVERSAMPLING_FACTOR; ++quality) {
+                    beginTest(juce::String(antialias ? "ADAA" : "no ADAA") + ", " + juce::String(bit) + " bits, quality " + juce::String(quality));
+
+                    MultibandDistortion distortion;
+                    auto params = makeParameters(100.0f, quality, antialias, bit);
+                    distortion.prepare(params);
+                    expectWithinAbsoluteError(measureDelay(distortion) - distortion.getLatencySamples(), reference, 1.0e-2, "delay past the latency");
+                }
+            }
+        }
+    }
+
+private:
+    // Phase delay of a quiet sine through the engine, from the second half
+    // of the output, once the start has died away.
+    static double measureDelay(MultibandDistortion& distortion) {
+        std::vector<float> buffer(numSamples);
+        for (int s = 0; s < numSamples; ++s) {
+            buffer[s] = 0.01f * static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * s));
+        }
+        for (int s = 0; s < numSamples; s += CONTROL_BLOCK_SIZE) {
+            float* channels[] = { buffer.data() + s };
+            distortion.processBlock(channels, 1, CONTROL_BLOCK_SIZE);
+        }
+
+        auto inPhase = 0.0, quadrature = 0.0;
+        for (int s = numSamples / 2; s < numSamples; ++s) {
+            auto w = juce::MathConstants<double>::twoPi * frequency * s;
+            inPhase += buffer[s] * std::sin(w);
+            quadrature += buffer[s] * std::cos(w);
+        }
+        return std::atan2(-quadrature, inPhase) / (juce::MathConstants<double>::twoPi * frequency);
+    }
+};
+
+static BandAlignmentTests bandAlignmentTests;
@@ -0,0 +1,91 @@
+#include <JuceHeader.h>
+#include "../Source/MultibandDistortion.h"
+
+namespace
+{
+    DSPParameters<float> makeChannelParameters(int numChannels) {
+        DSPParameters<float> params;
+        params.set("sampleRate", 48000.0f);
+        params.set("blockSize", static_cast<float>(CONTROL_BLOCK_SIZE));
+        params.set("nChannels", static_cast<float>(numChannels));
+        params.set("bands", 3.0f);
+        params.set("lowMidCut", 400.0f);
+        params.set("midHighCut", 4000.0f);
+        params.set("mix", 80.0f);
+
+        for (auto key : { "inputGain", "outputGain", "bypass", "nonRealtime", "renderQuality", "linearPhase",
+                          "linearPhaseCrossover", "tableShaper", "antialias" }) {
+            params.set(key, 0.0f);
+        }
+
+        for (int band = 0; band < MAX_BANDS; ++band) {
+            auto suffix = std::to_string(band + 1);
+            for (auto key : { "inputGain", "outputGain", "bypass" }) {
+                params.set(key + suffix, 0.0f);
+            }
+            // Each band at its own factor and curve, so the packed registers
+            // mix factors and kernels.
+            params.set("drive" + suffix, 6.0f + 6.0f * band);
+            params.set("knee" + suffix, 1.0f + band);
+            params.set("curve" + suffix, static_cast<float>(band % 3));
+            params.set("quality" + suffix, static_cast<float>(band % 3));
+            params.set("bit" + suffix, 32.0f);
+        }
+        return params;
+    }
+}
+
+// Past stereo the engine packs the bands of several channels into each
+// register. Every channel has to come out as it would from an engine
+// that processes that channel alone.
+class ChannelLayoutTests : public juce::UnitTest
+{
+public:
+    ChannelLayoutTests() : juce::UnitTest("Channel layout", "DSP") {}
+
+    void runTest() override {
+        for (auto numChannels : { 3, 6, 12 }) {
+            beginTest(juce::String(numChannels) + " channels");
+
+            MultibandDistortion packed;
+            auto params = makeChannelParameters(numChannels);
+            packed.prepare(params);
+
+            std::vector<std::unique_ptr<MultibandDistortion>> singles;
+            auto singleParams = makeChannelParameters(1);
+            for (int ch = 0; ch < numChannels; ++ch) {
+                singles.push_back(std::make_unique<MultibandDistortion>());
+                singles.back()->prepare(singleParams);
+            }
+
+            const int numBlocks = 64;
+            std::vector<std::vector<float>> buffers(numChannels, std::vector<float>(CONTROL_BLOCK_SIZE));
+            auto references = buffers;
+            std::vector<float*> channels(numChannels);
+            juce::Random random(numChannels);
+
+            auto worst = 0.0;
+            for (int block = 0; block < numBlocks; ++block) {
+                for (int ch = 0; ch < numChannels; ++ch) {
+                    for (auto& sample : buffers[ch]) sample = 0.5f * (random.nextFloat() - 0.5f);
+                    references[ch] = buffers[ch];
+                    channels[ch] = buffers[ch].data();
+                }
+
+                packed.processBlock(channels.data(), numChannels, CONTROL_BLOCK_SIZE);
+                for (int ch = 0; ch < numChannels; ++ch) {
+                    float* single[] = { references[ch].data() };
+                    singles[ch]->processBlock(single, 1, CONTROL_BLOCK_SIZE);
+
+                    for (int s = 0; s < CONTROL_BLOCK_SIZE; ++s) {
+                        worst = std::max(worst, std::abs(static_cast<double>(buffers[ch][s]) - references[ch][s]));
+                    }
+                }
+            }
+            // Only the summation order of the bands may differ.
+            expectLessThan(worst, 1.0e-5, "largest difference from the single-channel engines");
+        }
+    }
+};
+
+static ChannelLayoutTests channelLayoutTests;
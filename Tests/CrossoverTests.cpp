@@ -0,0 +1,132 @@
+#include <JuceHeader.h>
+#include "../Source/Filters.h"
+#include "../Source/MultibandDistortion.h"
+
+// The crossover's low and high outputs sum to an allpass, so an impulse
+// has to come out with all of its energy and then die away, at any cutoff
+// the parameters allow and any sample rate, including the low ones where
+// the top cutoffs lie past Nyquist.
+class LRFilterTests : public juce::UnitTest
+{
+public:
+    LRFilterTests() : juce::UnitTest("Linkwitz-Riley filter", "DSP") {}
+
+    void runTest() override {
+        for (auto sampleRate : { 22050.0f, 32000.0f, 44100.0f, 96000.0f }) {
+            beginTest("sample rate " + juce::String(sampleRate, 0));
+
+            for (auto cutoff : { 200.0f, 1000.0f, 10000.0f, 16000.0f, 20000.0f }) {
+                LRFilter<float> filter;
+                filter.prepare(sampleRate);
+                filter.setFrequency(cutoff);
+
+                const int numSamples = 16384;
+                auto energy = 0.0, lateEnergy = 0.0;
+                for (int s = 0; s < numSamples; ++s) {
+                    float low, high;
+                    filter.processSample(s == 0 ? 1.0f : 0.0f, low, high);
+                    auto sum = static_cast<double>(low) + high;
+                    energy += sum * sum;
+                    if (s >= numSamples / 2) lateEnergy += sum * sum;
+                }
+
+                auto name = juce::String(cutoff, 0) + " Hz";
+                expectWithinAbsoluteError(energy, 1.0, 1.0e-3, name + ": energy of low plus high");
+                expectLessThan(lateEnergy, 1.0e-9, name + ": energy left in the second half");
+            }
+        }
+    }
+};
+
+static LRFilterTests lrFilterTests;
+
+namespace
+{
+    DSPParameters<float> makeParameters(float lowMidCut, bool linearPhase) {
+        DSPParameters<float> params;
+        params.set("sampleRate", 48000.0f);
+        params.set("blockSize", static_cast<float>(CONTROL_BLOCK_SIZE));
+        params.set("nChannels", 1.0f);
+        params.set("bands", 2.0f);
+        params.set("lowMidCut", lowMidCut);
+        params.set("mix", 100.0f);
+        params.set("linearPhaseCrossover", linearPhase ? 1.0f : 0.0f);
+
+        for (auto key : { "inputGain", "outputGain", "bypass", "nonRealtime", "renderQuality", "linearPhase", "tableShaper", "antialias" }) {
+            params.set(key, 0.0f);
+        }
+
+        for (int band = 0; band < MAX_BANDS; ++band) {
+            auto suffix = std::to_string(band + 1);
+            for (auto key : { "inputGain", "drive", "bypass", "curve", "quality" }) {
+                params.set(key + suffix, 0.0f);
+            }
+            // The high band all but muted, so the output is the low band.
+            params.set("outputGain" + suffix, band == 0 ? 0.0f : -48.0f);
+            params.set("knee" + suffix, 1.0f);
+            params.set("bit" + suffix, 32.0f);
+        }
+        return params;
+    }
+}
+
+// A cutoff moved while the IIR tree runs has to reach the linear-phase
+// kernels before the engine switches over to them. The engine that
+// switches is held against one prepared with the linear-phase crossover
+// and the new cutoff from the start, once both have settled.
+class LinearPhaseCrossoverTests : public juce::UnitTest
+{
+public:
+    LinearPhaseCrossoverTests() : juce::UnitTest("Linear-phase crossover", "DSP") {}
+
+    void runTest() override {
+        beginTest("cutoffs moved in IIR mode");
+
+        const int numSamples = 48000;
+        std::vector<float> input(numSamples);
+        juce::Random random(1);
+        for (auto& sample : input) sample = 0.01f * (random.nextFloat() - 0.5f);
+
+        MultibandDistortion switched;
+        auto params = makeParameters(1000.0f, false);
+        switched.prepare(params);
+        auto switchedOutput = input;
+        process(switched, switchedOutput, 0, numSamples / 4);
+
+        // Two moves, each built while the tree runs.
+        for (auto cut : { 2000.0f, 4000.0f }) {
+            params.set("lowMidCut", cut);
+            switched.update(params);
+            switched.rebuildTables();
+        }
+        process(switched, switchedOutput, numSamples / 4, numSamples / 2);
+
+        params.set("linearPhaseCrossover", 1.0f);
+        switched.update(params);
+        process(switched, switchedOutput, numSamples / 2, numSamples);
+
+        MultibandDistortion reference;
+        auto referenceParams = makeParameters(4000.0f, true);
+        reference.prepare(referenceParams);
+        auto referenceOutput = input;
+        process(reference, referenceOutput, 0, numSamples);
+
+        auto error = 0.0, level = 0.0;
+        for (int s = numSamples * 3 / 4; s < numSamples; ++s) {
+            auto difference = static_cast<double>(switchedOutput[s]) - referenceOutput[s];
+            error += difference * difference;
+            level += static_cast<double>(referenceOutput[s]) * referenceOutput[s];
+        }
+        expectLessThan(std::sqrt(error / level), 1.0e-3, "difference from the reference, relative");
+    }
+
+private:
+    static void process(MultibandDistortion& distortion, std::vector<float>& buffer, int start, int end) {
+        for (int s = start; s < end; s += CONTROL_BLOCK_SIZE) {
+            float* channels[] = { buffer.data() + s };
+            distortion.processBlock(channels, 1, std::min(CONTROL_BLOCK_SIZE, end - s));
+        }
+    }
+};
+
+static LinearPhaseCrossoverTests linearPhaseCrossoverTests;
@@ -0,0 +1,89 @@
+#include <JuceHeader.h>
+#include "../Source/FastMath.h"
+#include "../Source/WaveshaperTable.h"
+
+// Every FastMath tier against libm, held to the bounds documented in
+// FastMath.h.
+class FastMathTests : public juce::UnitTest
+{
+public:
+    FastMathTests() : juce::UnitTest("FastMath", "DSP") {}
+
+    void runTest() override {
+        beginTest("fast");
+        checkAgainstLibm<FastMath::Accuracy::fast>(8.6e-5, 1.1e-4, 8.2e-5, 4.5e-5);
+
+        beginTest("balanced");
+        checkAgainstLibm<FastMath::Accuracy::balanced>(3.0e-6, 2.3e-6, 1.9e-6, 3.5e-6);
+
+        beginTest("precise");
+        checkAgainstLibm<FastMath::Accuracy::precise>(1.8e-7, 1.6e-7, 3.8e-7, 6.5e-7);
+    }
+
+private:
+    template <FastMath::Accuracy A>
+    void checkAgainstLibm(double exp2Bound, double log2Bound, double atanBound, double tanBound) {
+        auto exp2Error = 0.0, log2Error = 0.0, atanError = 0.0, tanError = 0.0;
+
+        for (auto x = -125.0f; x < 125.0f; x += 0.0037f) {
+            auto reference = std::exp2(static_cast<double>(x));
+            exp2Error = std::max(exp2Error, std::abs(FastMath::exp2<A>(x) - reference) / reference);
+        }
+        for (auto x = 0.25f; x < 4.0f; x *= 1.00001f) {
+            log2Error = std::max(log2Error, std::abs(FastMath::log2<A>(x) - std::log2(static_cast<double>(x))));
+        }
+        for (auto x = -64.0f; x < 64.0f; x += 0.0013f) {
+            atanError = std::max(atanError, std::abs(FastMath::atan<A>(x) - std::atan(static_cast<double>(x))));
+        }
+        for (auto x = 0.0001f; x < 1.5f; x += 0.00007f) {
+            auto reference = std::tan(static_cast<double>(x));
+            tanError = std::max(tanError, std::abs(FastMath::tan<A>(x) - reference) / reference);
+        }
+
+        expectLessThan(exp2Error, exp2Bound, "exp2 relative error");
+        expectLessThan(log2Error, log2Bound, "log2 absolute error");
+        expectLessThan(atanError, atanBound, "atan absolute error");
+        expectLessThan(tanError, tanBound, "tan relative error");
+
+        expectEquals(FastMath::exp2<A>(0.0f), 1.0f, "exp2(0)");
+        expectEquals(FastMath::log2<A>(1.0f), 0.0f, "log2(1)");
+        expectEquals(FastMath::exp2<A>(-200.0f), 0.0f, "exp2 underflow");
+        expectEquals(FastMath::pow<A>(0.0f, 0.5f), 0.0f, "pow(0, 0.5)");
+    }
+};
+
+// The clipper table against the analytic curve over the knee range, both
+// the lookup and the slope of its antiderivative.
+class WaveshaperTableTests : public juce::UnitTest
+{
+public:
+    WaveshaperTableTests() : juce::UnitTest("WaveshaperTable", "DSP") {}
+
+    void runTest() override {
+        auto table = std::make_unique<WaveshaperTable>();
+
+        for (auto knee : { 1.0f, 1.5f, 2.0f, 3.0f, 6.0f, 12.0f, 24.0f }) {
+            beginTest("knee " + juce::String(knee, 1));
+            table->build(knee);
+
+            // Between and on the table points.
+            auto maxError = 0.0;
+            for (auto x = 0.0; x < 64.0; x += x < 4.0 ? 0.0005 : 0.05) {
+                maxError = std::max(maxError, std::abs(table->lookup(static_cast<float>(x)) - WaveshaperTable::transfer(static_cast<float>(x), knee)));
+            }
+            expectLessThan(maxError, 1.0e-4, "lookup error");
+
+            // The antiderivative's slope has to match the curve.
+            auto maxSlopeError = 0.0;
+            for (auto x = 0.01; x < 64.0; x += x < 4.0 ? 0.01 : 0.5) {
+                auto h = 1.0e-3 * x;
+                auto slope = (table->lookupIntegral(static_cast<float>(x + h)) - table->lookupIntegral(static_cast<float>(x - h))) / (2.0 * h);
+                maxSlopeError = std::max(maxSlopeError, std::abs(slope - WaveshaperTable::transfer(x, knee)));
+            }
+            expectLessThan(maxSlopeError, 1.0e-2, "antiderivative slope error");
+        }
+    }
+};
+
+static FastMathTests fastMathTests;
+static WaveshaperTableTests waveshaperTableTests;
@@ -0,0 +1,25 @@
+#include <JuceHeader.h>
+
+// Runs every test, or only the categories named on the command line, e.g.
+// AttilaTests Benchmarks. Exits with 1 if any test failed.
+int main(int argc, char* argv[])
+{
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+
+    if (argc > 1) {
+        juce::Array<juce::UnitTest*> tests;
+        for (int i = 1; i < argc; ++i) {
+            tests.addArray(juce::UnitTest::getTestsInCategory(argv[i]));
+        }
+        runner.runTests(tests);
+    }
+    else {
+        runner.runAllTests();
+    }
+
+    for (int i = 0; i < runner.getNumResults(); ++i) {
+        if (runner.getResult(i)->failures > 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <JuceHeader.h>
+#include "../Source/LaneUtils.h"
+#include "../Source/Resampler.h"
+
+namespace
+{
+    const std::array<ResamplerDesign, 2> designs{ ResamplerDesign::minimumPhase, ResamplerDesign::linearPhase };
+
+    juce::String getName(ResamplerDesign design) {
+        return design == ResamplerDesign::linearPhase ? "linear phase" : "minimum phase";
+    }
+}
+
+// The round trip has to come out exactly getLatency() base-rate samples
+// late at low frequencies, or bands at different factors would not line
+// up with each other and the dry signal.
+class ResamplerTests : public juce::UnitTest
+{
+public:
+    ResamplerTests() : juce::UnitTest("Resampler", "DSP") {}
+
+    void runTest() override {
+        for (auto design : designs) {
+            for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) {
+                beginTest(getName(design) + ", factor " + juce::String(factor));
+
+                Resampler<float> resampler;
+                resampler.prepare(factor, design);
+                expectWithinAbsoluteError(measureDelay(resampler, factor), static_cast<double>(resampler.getLatency()), 1.0e-3, "delay at low frequencies");
+            }
+        }
+    }
+
+private:
+    // Phase delay of a sine of a few cycles per numSamples / 2, from the
+    // second half of the output, once the start has died away.
+    static double measureDelay(Resampler<float>& resampler, int factor) {
+        const int numSamples = 8192;
+        const double frequency = 4.0 / (numSamples / 2);
+        std::vector<float> input(numSamples), output(numSamples), oversampled(CONTROL_BLOCK_SIZE << factor);
+
+        for (int s = 0; s < numSamples; ++s) {
+            input[s] = static_cast<float>(std::sin(juce::MathConstants<double>::twoPi * frequency * s));
+        }
+        for (int s = 0; s < numSamples; s += CONTROL_BLOCK_SIZE) {
+            resampler.upsample(input.data() + s, oversampled.data(), CONTROL_BLOCK_SIZE);
+            resampler.downsample(oversampled.data(), output.data() + s, CONTROL_BLOCK_SIZE);
+        }
+
+        auto inPhase = 0.0, quadrature = 0.0;
+        for (int s = numSamples / 2; s < numSamples; ++s) {
+            auto w = juce::MathConstants<double>::twoPi * frequency * s;
+            inPhase += output[s] * std::sin(w);
+            quadrature += output[s] * std::cos(w);
+        }
+        return std::atan2(-quadrature, inPhase) / (juce::MathConstants<double>::twoPi * frequency);
+    }
+};
+
+// The in-house resampler against juce::dsp::Oversampling at every factor,
+// both as the engine uses them: one control block at a time, up and
+// straight back down, four signals at once. The resampler takes them as
+// the lanes of one register, Oversampling as four channels.
+class ResamplerBenchmark : public juce::UnitTest
+{
+public:
+    ResamplerBenchmark() : juce::UnitTest("Resampler against juce::dsp::Oversampling", "Benchmarks") {}
+
+    void runTest() override {
+        const int numSignals = static_cast<int>(Lane::SIMDNumElements);
+        const int numSamples = 10 * 44100;
+
+        juce::AudioBuffer<float> input(numSignals, numSamples);
+        juce::Random random(1);
+        for (int ch = 0; ch < numSignals; ++ch) {
+            for (int s = 0; s < numSamples; ++s) input.setSample(ch, s, random.nextFloat() - 0.5f);
+        }
+
+        for (auto design : designs) {
+            for (int factor = 1; factor <= MAX_OVERSAMPLING_FACTOR; ++factor) {
+                beginTest(getName(design) + ", factor " + juce::String(factor));
+
+                Resampler<Lane> resampler;
+                resampler.prepare(factor, design);
+                auto resamplerTime = timeResampler(input, resampler);
+
+                auto type = design == ResamplerDesign::linearPhase
+                    ? juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple
+                    : juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR;
+                juce::dsp::Oversampling<float> oversampling(static_cast<size_t>(numSignals), static_cast<size_t>(factor), type);
+                auto oversamplingTime = timeOversampling(input, oversampling);
+
+                logMessage("Resampler: " + juce::String(resamplerTime, 1) + " ms, latency " + juce::String(resampler.getLatency())
+                    + "; Oversampling: " + juce::String(oversamplingTime, 1) + " ms, latency " + juce::String(oversampling.getLatencyInSamples(), 2)
+                    + "; " + juce::String(oversamplingTime / resamplerTime, 2) + "x");
+                expect(resamplerTime > 0.0 && oversamplingTime > 0.0);
+            }
+        }
+    }
+
+private:
+    static double timeResampler(const juce::AudioBuffer<float>& input, Resampler<Lane>& resampler) {
+        // Frames as the engine keeps them, one register per sample.
+        std::vector<Lane> frames(static_cast<size_t>(input.getNumSamples()));
+        std::vector<Lane> oversampled(static_cast<size_t>(CONTROL_BLOCK_SIZE << resampler.getFactor()));
+        alignas(sizeof(Lane)) float frame[Lane::SIMDNumElements];
+        for (int s = 0; s < input.getNumSamples(); ++s) {
+            for (int ch = 0; ch < input.getNumChannels(); ++ch) frame[ch] = input.getSample(ch, s);
+            frames[static_cast<size_t>(s)] = Lane::fromRawArray(frame);
+        }
+
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        for (int s = 0; s + CONTROL_BLOCK_SIZE <= input.getNumSamples(); s += CONTROL_BLOCK_SIZE) {
+            resampler.upsample(frames.data() + s, oversampled.data(), CONTROL_BLOCK_SIZE);
+            resampler.downsample(oversampled.data(), frames.data() + s, CONTROL_BLOCK_SIZE);
+        }
+        return juce::Time::getMillisecondCounterHiRes() - start;
+    }
+
+    static double timeOversampling(const juce::AudioBuffer<float>& input, juce::dsp::Oversampling<float>& oversampling) {
+        juce::AudioBuffer<float> buffer(input);
+        oversampling.initProcessing(CONTROL_BLOCK_SIZE);
+
+        auto start = juce::Time::getMillisecondCounterHiRes();
+        juce::dsp::AudioBlock<float> whole(buffer);
+        for (int s = 0; s + CONTROL_BLOCK_SIZE <= buffer.getNumSamples(); s += CONTROL_BLOCK_SIZE) {
+            auto block = whole.getSubBlock(static_cast<size_t>(s), CONTROL_BLOCK_SIZE);
+            oversampling.processSamplesUp(block);
+            oversampling.processSamplesDown(block);
+        }
+        return juce::Time::getMillisecondCounterHiRes() - start;
+    }
+};
+
+static ResamplerTests resamplerTests;
+static ResamplerBenchmark resamplerBenchmark;